@@ -0,0 +1,126 @@
+/**
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/batch.c }
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * See the file LICENSE for details.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "lowm.h"
+#include "ewmh.h"
+#include "query.h"
+#include "subscribe.h"
+#include "tree.h"
+#include "batch.h"
+
+/* The batch of the client being served, if any. */
+static batch_t *current = NULL;
+
+batch_t *
+batch_enter(batch_t *b)
+{
+    batch_t *prev = current;
+
+    current = b;
+
+    return prev;
+}
+
+bool
+batch_begin(void)
+{
+    if (current == NULL)
+        return false;
+
+    if (current->depth++ == 0)
+        current->deadline = monotonic_ms() + BATCH_MAX_OPEN;
+
+    return true;
+}
+
+bool
+batch_commit(void)
+{
+    if (current == NULL || current->depth == 0)
+        return false;
+
+    if (--current->depth > 0)
+        return true;
+
+    batch_t *b = current;
+    int flags = b->pending;
+
+    b->pending = 0;
+
+    /* Desktops removed in the meantime aren't found anymore. */
+    for (size_t i = 0; i < b->desktops_len; i++) {
+        coordinates_t loc;
+
+        if (desktop_from_id(b->desktops[i], &loc, NULL))
+            arrange(loc.monitor, loc.desktop);
+    }
+
+    b->desktops_len = 0;
+    arrange_dirty();
+
+    if (flags & BATCH_CLIENT_LIST)
+        ewmh_update_client_list(false);
+
+    if (flags & BATCH_CLIENT_LIST_STACKING)
+        ewmh_update_client_list(true);
+
+    if (flags & BATCH_REPORT)
+        put_status(SBSC_MASK_REPORT);
+
+    return true;
+}
+
+unsigned int
+batch_level(void)
+{
+    return (current == NULL ? 0 : current->depth);
+}
+
+bool
+batch_defer(batch_flags_t flag)
+{
+    if (current == NULL || current->depth == 0)
+        return false;
+
+    current->pending |= flag;
+
+    return true;
+}
+
+bool
+batch_hold(desktop_t *d)
+{
+    if (current == NULL || current->depth == 0)
+        return false;
+
+    for (size_t i = 0; i < current->desktops_len; i++) {
+        if (current->desktops[i] == d->id)
+            return true;
+    }
+
+    if (current->desktops_len == current->desktops_cap) {
+        size_t cap = (current->desktops_cap == 0 ? INIT_CAP : current->desktops_cap * 2);
+        uint32_t *ids = realloc(current->desktops, cap * sizeof(uint32_t));
+
+        /* It'll be laid out right away instead. */
+        if (ids == NULL) {
+            perror("batch: realloc");
+
+            return false;
+        }
+
+        current->desktops = ids;
+        current->desktops_cap = cap;
+    }
+
+    current->desktops[current->desktops_len++] = d->id;
+
+    return true;
+}
@@ -0,0 +1,36 @@
+/**
+ * LOWM: An advanced tiling window manager for Unix.
+ *
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/batch.h }.
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * Refer to the file LICENSE for additional details.
+**/
+
+#ifndef LOWM_BATCH_H
+#define LOWM_BATCH_H
+
+#define BATCH_MAX_OPEN 1000
+
+typedef enum {
+    BATCH_CLIENT_LIST = 1 << 0,
+    BATCH_CLIENT_LIST_STACKING = 1 << 1,
+    BATCH_REPORT = 1 << 2,
+} batch_flags_t;
+
+/**
+ * Each connection has its own batch, entered while its commands are
+ * served. Between `begin` and the matching `commit`, the desktops its
+ * commands arrange are held rather than laid out, and the client lists
+ * and the report are only flagged as outdated: commit brings everything
+ * up to date once. What other clients and the X server do meanwhile
+ * isn't held, and a batch open for more than BATCH_MAX_OPEN milliseconds
+ * is committed on its client's behalf.
+**/
+batch_t *batch_enter(batch_t *b);
+bool batch_begin(void);
+bool batch_commit(void);
+unsigned int batch_level(void);
+bool batch_defer(batch_flags_t flag);
+bool batch_hold(desktop_t *d);
+
+#endif
@@ -11,6 +11,19 @@
 
 #define SOCKET_PATH_TPL "/tmp/lowm/%s_%i_%i-socket"
 #define SOCKET_ENV_VAR "LOWM_SOCKET"
+#define SNAPSHOT_PATH_TPL "/tmp/lowm/%s_%i_%i-snapshot"
+#define SNAPSHOT_ENV_VAR "LOWM_SNAPSHOT"
+#define JOURNAL_PATH_TPL "/tmp/lowm/%s_%i_%i-journal"
+#define JOURNAL_ENV_VAR "LOWM_JOURNAL"
 #define FAILURE_MESSAGE "\x07"
 
+/**
+ * A connection whose first byte is SESSION_MESSAGE carries any number of
+ * commands: each one is its number of arguments, in decimal, followed by
+ * that many arguments, all NUL terminated. Arguments may be empty. Each
+ * reply is followed by a NUL character.
+**/
+#define SESSION_MESSAGE "\x1e"
+#define SESSION_COUNT_MAX 16
+
 #endif
@@ -0,0 +1,134 @@
+/**
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/delta.c }
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * See the file LICENSE for details.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lowm.h"
+#include "index.h"
+#include "query.h"
+#include "subscribe.h"
+#include "delta.h"
+
+static uint64_t generation = 0;
+
+/* A ring, oldest first, and the generation of the last tombstone it lost. */
+static tombstone_t tombstones[TOMBSTONE_MAX];
+static size_t tombstones_head = 0;
+static size_t tombstones_len = 0;
+static uint64_t forgotten = 0;
+
+uint64_t
+next_generation(void)
+{
+    return ++generation;
+}
+
+uint64_t
+current_generation(void)
+{
+    return generation;
+}
+
+void
+touch_monitor(monitor_t *m)
+{
+    if (m != NULL)
+        m->generation = next_generation();
+}
+
+void
+touch_desktop(desktop_t *d)
+{
+    if (d != NULL)
+        d->generation = next_generation();
+}
+
+void
+touch_node(node_t *n)
+{
+    if (n != NULL)
+        n->generation = next_generation();
+}
+
+/* Nodes moved to another desktop, along with their descendants. */
+void
+touch_node_in(node_t *n)
+{
+    if (n == NULL)
+        return;
+
+    touch_node(n);
+    touch_node_in(n->first_child);
+    touch_node_in(n->second_child);
+}
+
+/**
+ * Whatever an event is about has changed. Focusing or activating also
+ * changes what the enclosing object reports as focused.
+**/
+void
+touch_event(int mask, uint32_t *ids, int depth)
+{
+    coordinates_t loc;
+
+    if (mask & (SBSC_MASK_MONITOR_REMOVE | SBSC_MASK_DESKTOP_REMOVE | SBSC_MASK_NODE_REMOVE))
+        return;
+
+    if (depth == 3 && index_find(ids[2], &loc)) {
+        touch_node(loc.node);
+
+        if (mask & (SBSC_MASK_NODE_ADD | SBSC_MASK_NODE_FOCUS | SBSC_MASK_NODE_ACTIVATE))
+            touch_desktop(loc.desktop);
+    } else if (depth == 2 && desktop_from_id(ids[1], &loc, NULL)) {
+        touch_desktop(loc.desktop);
+
+        if (mask & (SBSC_MASK_DESKTOP_ADD | SBSC_MASK_DESKTOP_FOCUS | SBSC_MASK_DESKTOP_ACTIVATE))
+            touch_monitor(loc.monitor);
+    } else if (depth == 1 && monitor_from_id(ids[0], &loc)) {
+        touch_monitor(loc.monitor);
+    }
+}
+
+void
+bury(tombstone_kind_t kind, uint32_t id)
+{
+    if (tombstones_len == TOMBSTONE_MAX) {
+        forgotten = tombstones[tombstones_head].generation;
+        tombstones_head = (tombstones_head + 1) % TOMBSTONE_MAX;
+        tombstones_len--;
+    }
+
+    tombstone_t *t = &tombstones[(tombstones_head + tombstones_len++) % TOMBSTONE_MAX];
+
+    t->kind = kind;
+    t->id = id;
+    t->generation = next_generation();
+}
+
+/* Tell whether every removal that happened after the given generation is still known. */
+bool
+delta_covers(uint64_t since)
+{
+    return (since >= forgotten && since <= generation);
+}
+
+size_t
+tombstones_count(void)
+{
+    return tombstones_len;
+}
+
+tombstone_t *
+tombstone_get(size_t i)
+{
+    if (i >= tombstones_len)
+        return NULL;
+
+    return &tombstones[(tombstones_head + i) % TOMBSTONE_MAX];
+}
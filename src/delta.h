@@ -0,0 +1,44 @@
+/**
+ * LOWM: An advanced tiling window manager for Unix.
+ *
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/delta.h }.
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * Refer to the file LICENSE for additional details.
+**/
+
+#ifndef LOWM_DELTA_H
+#define LOWM_DELTA_H
+
+#define TOMBSTONE_MAX 1024
+
+typedef enum {
+    TOMBSTONE_MONITOR,
+    TOMBSTONE_DESKTOP,
+    TOMBSTONE_NODE,
+} tombstone_kind_t;
+
+typedef struct {
+    tombstone_kind_t kind;
+    uint32_t id;
+    uint64_t generation;
+} tombstone_t;
+
+/**
+ * Every monitor, desktop and node remembers the generation at which it
+ * last changed, and the ids of the removed ones are kept along with the
+ * generation of their removal, for the last TOMBSTONE_MAX of them.
+ * Together, they tell what changed since any recent generation.
+**/
+uint64_t next_generation(void);
+uint64_t current_generation(void);
+void touch_monitor(monitor_t *m);
+void touch_desktop(desktop_t *d);
+void touch_node(node_t *n);
+void touch_node_in(node_t *n);
+void touch_event(int mask, uint32_t *ids, int depth);
+void bury(tombstone_kind_t kind, uint32_t id);
+bool delta_covers(uint64_t since);
+size_t tombstones_count(void);
+tombstone_t *tombstone_get(size_t i);
+
+#endif
@@ -8,8 +8,10 @@
 #include <stdbool.h>
 
 #include "lowm.h"
+#include "delta.h"
 #include "ewmh.h"
 #include "history.h"
+#include "index.h"
 #include "monitor.h"
 #include "query.h"
 #include "tree.h"
@@ -170,6 +172,11 @@ transfer_desktop(monitor_t *ms, monitor_t *md, desktop_t *d, bool follow)
     }
 
     insert_desktop(md, d);
+    index_add_in(md, d, d->root);
+    touch_node_in(d->root);
+    touch_desktop(d);
+    touch_monitor(ms);
+    touch_monitor(md);
     history_remove(d, NULL, false);
 
     if (d_was_active) {
@@ -238,6 +245,10 @@ make_desktop(const char *name, uint32_t id)
     d->padding = (padding_t)PADDING;
     d->window_gap = window_gap;
     d->border_width = border_width;
+    d->dirty = false;
+    d->settled = 0;
+    d->generation = next_generation();
+    d->hist = d->hist_head = d->hist_tail = NULL;
 
     return d;
 }
@@ -331,6 +342,8 @@ remove_desktop(monitor_t *m, desktop_t *d)
     remove_node(m, d, d->root);
     unlink_desktop(m, d);
     history_remove(d, NULL, false);
+    bury(TOMBSTONE_DESKTOP, d->id);
+    touch_monitor(m);
     free(d);
 
     ewmh_update_current_desktop();
@@ -433,10 +446,18 @@ swap_desktops(monitor_t *m1, desktop_t *d1, monitor_t *m2, desktop_t *d2, bool f
     d1->next = n2 == d1 ? d2 : n2;
     d2->prev = p1 == d2 ? d1 : p1;
     d2->next = n1 == d2 ? d1 : n1;
+    touch_desktop(d1);
+    touch_desktop(d2);
+    touch_monitor(m1);
+    touch_monitor(m2);
 
     if (m1 != m2) {
         adapt_geometry(&m1->rectangle, &m2->rectangle, d1->root);
         adapt_geometry(&m2->rectangle, &m1->rectangle, d2->root);
+        index_add_in(m2, d1, d1->root);
+        index_add_in(m1, d2, d2->root);
+        touch_node_in(d1->root);
+        touch_node_in(d2->root);
         history_remove(d1, NULL, false);
         history_remove(d2, NULL, false);
         arrange(m1, d2);
@@ -93,6 +93,29 @@ map_request(xcb_generic_event_t *evt)
     schedule_window(e->window);
 }
 
+/**
+ * The ConfigureNotify a client is owed when its request didn't move or
+ * resize its window, as required by the ICCCM.
+**/
+static void
+notify_configure(xcb_window_t win, xcb_rectangle_t r, unsigned int bw)
+{
+    xcb_configure_notify_event_t evt;
+
+    evt.response_type = XCB_CONFIGURE_NOTIFY;
+    evt.event = win;
+    evt.window = win;
+    evt.above_sibling = XCB_NONE;
+    evt.x = r.x;
+    evt.y = r.y;
+    evt.width = r.width;
+    evt.height = r.height;
+    evt.border_width = bw;
+    evt.override_redirect = false;
+
+    xcb_send_event(dpy, false, win, XCB_EVENT_MASK_STRUCTURE_NOTIFY, (const char *)&evt);
+}
+
 void
 configure_request(xcb_generic_event_t *evt)
 {
@@ -164,7 +187,10 @@ configure_request(xcb_generic_event_t *evt)
         c->floating_rectangle.height = height;
         xcb_rectangle_t r = c->floating_rectangle;
 
-        window_move_resize(e->window, r.x, r.y, r.width, r.height);
+        /* Nothing changed, and the server won't tell the client so. */
+        if (!window_move_resize(e->window, r.x, r.y, r.width, r.height))
+            notify_configure(e->window, r, c->border_width);
+
         put_status(SBSC_MASK_NODE_GEOMETRY, "node_geometry 0x%08X 0x%08X "
             "0x%08X %ux%u+%i+%i\n", loc.monitor->id, lock.desktop->id,
             e->window, r.width, r.height, r.x, r.y);
@@ -189,28 +215,15 @@ configure_request(xcb_generic_event_t *evt)
             if (width != c->floating_rectangle.width || height != c->floating_rectangle.height) {
                 c->floating_rectangle.width = width;
                 c->floating_rectangle.height = height;
+                invalidate_layout(loc.node);
                 arrange(loc.monitor, loc.desktop);
             }
         }
 
-        xcb_configure_notify_event_t evt;
-        unsigned int bw = c->border_width;
         xcb_rectangle_t r = IS_FULLSCREEN(c) ? loc.monitor->rectangle :
             c->tiled_rectangle;
 
-        evt.response_type = XCB_CONFIGURE_NOTIFY;
-        evt.event = e->window;
-        evt.window = e->window;
-        evt.above_sibling = XCB_NONE;
-        evt.x = r.x;
-        evt.y = r.y;
-        evt.width = r.width;
-        evt.height = r.height;
-        evt.border_width = bw;
-        evt.override_redirect = false;
-
-        xcb_send_event(dpy, false, e->window, XCB_EVENT_MASK_STRUCTURE_NOTIFY,
-            (const char *)&evt);
+        notify_configure(e->window, r, c->border_width);
     }
 }
 
@@ -222,6 +235,9 @@ configure_notify(xcb_generic_event_t *evt)
     if (e->window == root) {
         screen_width = e->width;
         screen_height = e->height;
+    } else if (window_shadow(e->window) == NULL) {
+        /* Someone else's window moved in the stack, ours might not be where we left them. */
+        window_stacking_changed();
     }
 }
 
@@ -300,8 +316,10 @@ property_notify(xcb_generic_event_t *evt)
     } else if (e->atom == XCB_ATOM_WM_NORMAL_HINTS) {
         client_t *c = loc.node->client;
 
+        invalidate_layout(loc.node);
+
         if (xcb_icccm_get_wm_normal_hints_reply(dpy, xcb_icccm_get_wm_normal_hints(dpy,
-            e->window), &c->size_hints, arrange(loc.monitor, loc.destop)));
+            e->window), &c->info->size_hints, arrange(loc.monitor, loc.destop)));
     }
 }
 
@@ -9,6 +9,7 @@
 #include <unistd.h>
 
 #include "lowm.h"
+#include "batch.h"
 #include "settings.h"
 #include "tree.h"
 #include "ewmh.h"
@@ -196,68 +197,76 @@ bool
 ewmh_handle_struts(xcb_window_t win)
 {
     xcb_ewmh_wm_strut_partial_t struts;
+
+    if (xcb_ewmh_get_wm_strut_partial_reply(ewmh, xcb_ewmh_get_wm_strut_partial(ewmh, win),
+        &struts, NULL) == 1)
+            return ewmh_apply_struts(struts);
+
+    return false;
+}
+
+bool
+ewmh_apply_struts(xcb_ewmh_wm_strut_partial_t struts)
+{
     bool changed = false;
     monitor_t *m;
 
-    if (xcb_ewmh_get_wm_struct_partial_reply(ewmh, xcb_ewmh_get_wm_strut_partial(ewmh, win),
-        &struts, NULL) == 1) {
-        for (*m = mon_head; m != NULL; m = m->next) {
-            xcb_rectangle_t rect = m->rectangle;
+    for (*m = mon_head; m != NULL; m = m->next) {
+        xcb_rectangle_t rect = m->rectangle;
 
-            if (rect.x < (int8_t)struts.left && (int16_t)struts.left < (rect.x + rect.width -
-                1) && (int16_t)struts.left_end_y >= rect.y && (int16_t)strts.left_start_y <
-                (rect.y + rect.height)) {
-                    int dx = struts.left - rect.x;
+        if (rect.x < (int8_t)struts.left && (int16_t)struts.left < (rect.x + rect.width -
+            1) && (int16_t)struts.left_end_y >= rect.y && (int16_t)strts.left_start_y <
+            (rect.y + rect.height)) {
+                int dx = struts.left - rect.x;
 
-                    if (m->padding.left < 0)
-                        m->padding.left += dx;
-                    else
-                        m->padding.left = MAX(dx, m->padding.left);
+                if (m->padding.left < 0)
+                    m->padding.left += dx;
+                else
+                    m->padding.left = MAX(dx, m->padding.left);
 
-                    changed = true;
-            }
+                changed = true;
+        }
 
-            if ((rect.x + rect.width) > (int16_t)(screen_width - struts.right) &&
-                (int16_t)(screen_width - struts.right) > rect.x &&
-                (int16_t)struts.right_end_y >= rect.y &&
-                (int16_t)struts.right_start_y < (rect.y + rect.height)) {
-                    int dx = (rect.x + rect.width) - screen_width + struts.right;
+        if ((rect.x + rect.width) > (int16_t)(screen_width - struts.right) &&
+            (int16_t)(screen_width - struts.right) > rect.x &&
+            (int16_t)struts.right_end_y >= rect.y &&
+            (int16_t)struts.right_start_y < (rect.y + rect.height)) {
+                int dx = (rect.x + rect.width) - screen_width + struts.right;
 
-                    if (m->padding.right < 0)
-                        m->padding.right += dx;
-                    else
-                        m->padding.right = MAX(dx, m->padding.right);
+                if (m->padding.right < 0)
+                    m->padding.right += dx;
+                else
+                    m->padding.right = MAX(dx, m->padding.right);
 
-                    changed = true;
-            }
+                changed = true;
+        }
 
-            if (rect.y < (int16_t)struts.top &&
-                (int16_t)struts.top < (rect.y + rect.height -1) &&
-                (int16_t)struts.right_end_y >= rect.y &&
-                (int16_t)struts.right_start_y < (rect.y + rect.height)) {
-                    int dy = struts.top  - rect.y;
+        if (rect.y < (int16_t)struts.top &&
+            (int16_t)struts.top < (rect.y + rect.height -1) &&
+            (int16_t)struts.right_end_y >= rect.y &&
+            (int16_t)struts.right_start_y < (rect.y + rect.height)) {
+                int dy = struts.top  - rect.y;
 
-                    if (m->padding.top < 0)
-                        m->padding_top += dy;
-                    else
-                        m->padding.top = MAX(dy, m->padding.top);
+                if (m->padding.top < 0)
+                    m->padding_top += dy;
+                else
+                    m->padding.top = MAX(dy, m->padding.top);
 
-                    changed = true;
-            }
+                changed = true;
+        }
 
-            if ((rect.y + rect.height) > (int16_t)(screen_height - struts.bottom) &&
-                (int16_t)(screen_height - struts.bottom) > rect.y &&
-                (int16_t)struts.bottom_end_x >= rect.x &&
-                (int16_t)struts.bottom_start_x >= (rect.x + rect.width)) {
-                    int dy = (rect.y + rect.height) - screen_height + struts.bottom;
+        if ((rect.y + rect.height) > (int16_t)(screen_height - struts.bottom) &&
+            (int16_t)(screen_height - struts.bottom) > rect.y &&
+            (int16_t)struts.bottom_end_x >= rect.x &&
+            (int16_t)struts.bottom_start_x >= (rect.x + rect.width)) {
+                int dy = (rect.y + rect.height) - screen_height + struts.bottom;
 
-                    if (m->padding.bottom < 0)
-                        m->padding.bottom += dy;
-                    else
-                        m->padding.bottom = MAX(dy, m->padding.bottom);
+                if (m->padding.bottom < 0)
+                    m->padding.bottom += dy;
+                else
+                    m->padding.bottom = MAX(dy, m->padding.bottom);
 
-                    changed = true;
-            }
+                changed = true;
         }
     }
 
@@ -267,6 +276,9 @@ ewmh_handle_struts(xcb_window_t win)
 void
 ewmh_update_client_list(bool stacking)
 {
+    if (batch_defer(stacking ? BATCH_CLIENT_LIST_STACKING : BATCH_CLIENT_LIST))
+        return;
+
     if (clients_count == 0) {
         xcb_ewmh_set_client_list(ewmh, default_screen, 0, NULL);
         xcb_ewmh_set_client_list_stacking(ewmh, default_screen, 0, NULL);
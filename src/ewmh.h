@@ -21,6 +21,7 @@ void ewmh_update_wm_desktops(void);
 void ewmh_update_desktop_names(void);
 void ewmh_update_desktop_viewport(void);
 bool ewmh_handle_struts(xcb_window_t win);
+bool ewmh_apply_struts(xcb_ewmh_wm_strut_partial_t struts);
 void ewmh_update_client_list(bool stacking);
 void ewmh_wm_state_update(node_t *n);
 void ewmh_set_supporting(xcb_window_t win);
@@ -12,6 +12,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <time.h>
 
 #include "lowm.h"
 
@@ -200,3 +201,27 @@ is_hex_color(const char *color)
 
     return true;
 }
+
+uint64_t
+monotonic_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* FNV-1a, for the tables keyed by strings. */
+uint32_t
+hash_string(const char *s)
+{
+    uint32_t h = 2166136261u;
+
+    for (; *s != '\0'; s++) {
+        h ^= (unsigned char) *s;
+        h *= 16777619u;
+    }
+
+    return h;
+}
@@ -34,6 +34,8 @@
 #define AUTO_SCM_STR(A)					((A) == SCHEME_LONGEST_SIDE ? "longest_side" : \
 	((A) == SCHEME_ALTERNATE ? "alternate" : "spiral"))
 #define TIGHTNESS_STR(A) 				((A) == TIGHTNESS_HIGH ? "high" : "low")
+#define SBSC_POLICY_STR(A)			((A) == SBSC_POLICY_DROP_OLDEST ? "drop_oldest" : \
+	((A) == SBSC_POLICY_COALESCE ? "coalesce" : "disconnect"))
 #define SPLIT_TYPE_STR(A) 			((A) == TYPE_HORIZONTAL ? "horizontal" : "vertical")
 #define SPLIT_MODE_STR(A)				((A) == MODE_AUTOMATIC ? "automatic" : "manual")
 #define SPLIT_DIR_STR(A)				((A) == DIR_NORTH ? "north" : ((A) == DIR_WEST ? "west" : \
@@ -72,5 +74,7 @@ char *copy_string(char *str, size_t len);
 char *mktempfifo(const char *template);
 int asprintf(char **buf, const char *fmt, va_list args);
 bool is_hex_color(const char *color);
+uint64_t monotonic_ms(void);
+uint32_t hash_string(const char *s);
 
 #endif
@@ -6,24 +6,144 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "lowm.h"
 #include "tree.h"
+#include "pool.h"
 #include "query.h"
 #include "history.h"
 
+/* Room left between consecutive order labels, and the label of a lone entry. */
+#define HISTORY_GAP (1ULL << 20)
+#define HISTORY_ORIGIN (1ULL << 62)
+
+static pool_t history_pool = POOL_INIT(history_t);
+
 history_t *
 make_history(monitor_t *m, desktop_t *d, node_t *n)
 {
-    history_t *h = calloc(1, sizeof(history_t));
+    history_t *h = pool_alloc(&history_pool);
 
     h->loc = (coordinates_t) { m, d, n };
+    h->order = HISTORY_ORIGIN;
     h->prev = h->next = NULL;
-    h->latest = true;
+    h->desk_prev = h->desk_next = NULL;
 
     return h;
 }
 
+/* Spread the labels evenly again, once two neighbours leave no room in between. */
+static void
+history_relabel(void)
+{
+    uint64_t order = HISTORY_ORIGIN;
+
+    for (history_t *h = history_head; h != NULL; h = h->next) {
+        h->order = order;
+        order += HISTORY_GAP;
+    }
+}
+
+/* The desktop chain is almost always appended to, hence the walk from its tail. */
+static void
+desk_link(history_t *h)
+{
+    desktop_t *d = h->loc.desktop;
+
+    if (d == NULL)
+        return;
+
+    history_t *b = d->hist_tail;
+
+    while (b != NULL && b->order > h->order)
+        b = b->desk_prev;
+
+    h->desk_prev = b;
+    h->desk_next = (b != NULL ? b->desk_next : d->hist_head);
+
+    if (h->desk_next != NULL)
+        h->desk_next->desk_prev = h;
+    else
+        d->hist_tail = h;
+
+    if (b != NULL)
+        b->desk_next = h;
+    else
+        d->hist_head = h;
+}
+
+static void
+desk_unlink(history_t *h)
+{
+    desktop_t *d = h->loc.desktop;
+
+    if (d == NULL)
+        return;
+
+    if (h->desk_prev != NULL)
+        h->desk_prev->desk_next = h->desk_next;
+    else
+        d->hist_head = h->desk_next;
+
+    if (h->desk_next != NULL)
+        h->desk_next->desk_prev = h->desk_prev;
+    else
+        d->hist_tail = h->desk_prev;
+
+    h->desk_prev = h->desk_next = NULL;
+}
+
+/* Take an entry out of both chains and drop the back-pointer to it. */
+static void
+history_unlink(history_t *h)
+{
+    if (h->prev != NULL)
+        h->prev->next = h->next;
+
+    if (h->next != NULL)
+        h->next->prev = h->prev;
+
+    if (history_head == h)
+        history_head = h->next;
+
+    if (history_tail == h)
+        history_tail = h->prev;
+
+    if (history_needle == h)
+        history_needle = h->prev;
+
+    desk_unlink(h);
+
+    if (h->loc.node != NULL && h->loc.node->hist == h)
+        h->loc.node->hist = NULL;
+    else if (h->loc.node == NULL && h->loc.desktop != NULL && h->loc.desktop->hist == h)
+        h->loc.desktop->hist = NULL;
+
+    pool_free(&history_pool, h);
+}
+
+/* The oldest or the newest entry among the desktops of the given monitor. */
+static history_t *
+monitor_history_edge(monitor_t *m, bool newest)
+{
+    history_t *e = NULL;
+
+    for (desktop_t *d = m->desk_head; d != NULL; d = d->next) {
+        history_t *h = (newest ? d->hist_tail : d->hist_head);
+
+        if (h != NULL && (e == NULL || (newest ? h->order > e->order : h->order < e->order)))
+            e = h;
+    }
+
+    return e;
+}
+
+/**
+ * The new entry supersedes the previous one of its node or desktop,
+ * which is removed after the new one took its place, so that the history
+ * never holds more than one entry per node and desktop.
+**/
 void
 history_add(monitor_t *m, desktop_t *d, node_t *n, bool focused)
 {
@@ -33,48 +153,50 @@ history_add(monitor_t *m, desktop_t *d, node_t *n, bool focused)
     if (focused)
         history_needle = NULL;
 
+    if (history_tail != NULL && ((n != NULL && history_tail->loc.node == n) ||
+        (n == NULL && d == history_tail->loc.desktop)))
+            return;
+
+    history_t *old = (n != NULL ? n->hist : d->hist);
     history_t *h = make_history(m, d, n);
 
     if (history_head == NULL) {
         history_head = history_tail = h;
-    } else if ((n != NULL && history_tail->loc.node != n) ||
-        n == NULL && d != history_tail->loc.desktop) {
-            history_t *ip = focused ? history_tail : NULL;
-
-        for (history_t *hh = history_tail; hh != NULL; hh = hh->prev) {
-            if ((n != NULL && hh->loc.node == n) || (n == NULL && d == hh->loc.desktop))
-                hh->latest = false;
-
-            if (ip == NULL && ((n != NULL && hh->loc.desktop == d) ||
-                (n == NULL && hh->loc.monitor == m)))
-                    ip = hh;
-        }
+        desk_link(h);
+    } else if (focused) {
+        history_insert_after(h, history_tail);
+    } else {
+        history_t *ip = (n != NULL ? d->hist_tail : monitor_history_edge(m, true));
 
         if (ip != NULL) {
             history_insert_after(h, ip);
         } else {
-            ip = history_head;
-
-            if (n != NULL) {
-                for (history_t *hh = history_head; hh != NULL; hh = hh->next) {
-                    if (hh->latest && hh->loc.monitor == m) {
-                        tp = hh;
-                        break;
-                    }
-                }
-            }
-
-            history_insert_before(h, ip);
+            ip = (n != NULL ? monitor_history_edge(m, false) : NULL);
+            history_insert_before(h, ip != NULL ? ip : history_head);
         }
-    } else {
-        free(h);
     }
+
+    if (old != NULL)
+        history_unlink(old);
+
+    if (n != NULL)
+        n->hist = h;
+    else
+        d->hist = h;
 }
 
 /* Inserts `a` after `b` */
 void
 history_insert_after(history_t *a, history_t *b)
 {
+    if (b->next != NULL && b->next->order - b->order < 2)
+        history_relabel();
+
+    if (b->next != NULL)
+        a->order = b->order + (b->next->order - b->order) / 2;
+    else
+        a->order = b->order + HISTORY_GAP;
+
     a->next = b->next;
 
     if (b->next != NULL)
@@ -85,12 +207,23 @@ history_insert_after(history_t *a, history_t *b)
 
     if (history_tail == b)
         history_tail = a;
+
+    desk_link(a);
 }
 
 /* Inserts `a` before `b` */
 void
 history_insert_before(history_t *a, history_t *b)
 {
+    if ((b->prev != NULL && b->order - b->prev->order < 2) ||
+        (b->prev == NULL && b->order < HISTORY_GAP))
+            history_relabel();
+
+    if (b->prev != NULL)
+        a->order = b->prev->order + (b->order - b->prev->order) / 2;
+    else
+        a->order = b->order - HISTORY_GAP;
+
     a->prev = b->prev;
 
     if (b->prev != NULL)
@@ -101,82 +234,57 @@ history_insert_before(history_t *a, history_t *b)
 
     if (history_head == b)
         history_head = a;
+
+    desk_link(a);
 }
 
-void
-history_remove(desktop_t *d, node_t *n, bool deep)
+static void
+history_remove_in(node_t *n)
 {
-    /**
-     * Removing from the newest to the oldest is required for
-     * maintaining the _latest_ attribute.
-    **/
-    history_t *b = history_tail;
-
-    while (b != NULL) {
-        if ((n != NULL && ((deep && is_descendent(b->loc.node, n))) || (n == NULL && d == b->loc.desktop))) {
-            history_t *a = b->next;
-            history_t *c = b->prev;
-
-            if (a != NULL) {
-                /* Remove duplicate entries */
-                while (c != NULL && ((a->loc.nod != NULL && a->loc.node == c->loc.node) ||
-                    a->loc.node == NULL && a->loc.desktop == c->loc.desktop)) {
-                        history_t *p = c->prev;
-
-                        if (history_head == c)
-                            history_head = history_tail;
-
-                        if (history_needle == c)
-                            history_needle = history_tail;
-
-                        free(c);
-                        c = p;
-                }
-
-                a->prev = c;
-            }
-
-            if (c != NULL)
-                c->next = a;
-
-            if (history_tail == b)
-                history_tail = c;
+    if (n == NULL)
+        return;
 
-            if (history_head == b)
-                history_head = a;
+    if (n->hist != NULL)
+        history_unlink(n->hist);
 
-            if (history_needle == b)
-                history_needle = c;
+    history_remove_in(n->first_child);
+    history_remove_in(n->second_child);
+}
 
-            free(b);
-            b = c;
-        } else {
-            b = b->prev;
-        }
+/**
+ * Without a node, every entry of the desktop goes. Otherwise, the entry
+ * of the node goes, along with the ones of its descendants if `deep` is
+ * set. The back-pointers lead straight to them.
+**/
+void
+history_remove(desktop_t *d, node_t *n, bool deep)
+{
+    if (n != NULL) {
+        if (deep)
+            history_remove_in(n);
+        else if (n->hist != NULL)
+            history_unlink(n->hist);
+    } else {
+        while (d->hist_tail != NULL)
+            history_unlink(d->hist_tail);
     }
 }
 
 void
 empty_history(void)
 {
-    history_t *h = history_head;
+    while (history_tail != NULL)
+        history_unlink(history_tail);
 
-    while (h != NULL) {
-        history_t *next = h->next;
-        free(h);
-        h = next;
-    }
-
-    history_head = history_tail = NULL;
+    history_head = history_tail = history_needle = NULL;
 }
 
 node_t *
 history_last_node(desktop_t *d, node_t *n)
 {
-    for (history_t *h = history_tail; h != NULL; h = h->prev) {
-        if (h->latest && h->loc.node != NULL && !h->loc.node->hidden &&
-            !is_descendent(h->loc.node, n) && h->loc.desktop == d)
-                return h->loc.node;
+    for (history_t *h = d->hist_tail; h != NULL; h = h->desk_prev) {
+        if (h->loc.node != NULL && !h->loc.node->hidden && !is_descendent(h->loc.node, n))
+            return h->loc.node;
     }
 
     return NULL;
@@ -185,19 +293,21 @@ history_last_node(desktop_t *d, node_t *n)
 desktop_t *
 history_last_desktop(monitor_t *m, desktop_t *d)
 {
-    for (history_t *h = history_tail; h != NULL; h = h->prev) {
-        if (h->latest && h->loc.desktop != h->loc.monitor == m)
-            return h->loc.desktop;
+    history_t *e = NULL;
+
+    for (desktop_t *dd = m->desk_head; dd != NULL; dd = dd->next) {
+        if (dd != d && dd->hist_tail != NULL && (e == NULL || dd->hist_tail->order > e->order))
+            e = dd->hist_tail;
     }
 
-    return NULL;
+    return (e != NULL ? e->loc.desktop : NULL);
 }
 
 monitor_t *
 history_last_monitor(monitor_t *m)
 {
     for (history_t *h = history_tail; h != NULL; h = h->prev) {
-        if (h->latest && h->loc.monitor != m)
+        if (h->loc.monitor != m)
             return h->loc.monitor;
     }
 
@@ -228,7 +338,7 @@ history_find_node(history_dir_t hdt, coordinates_t *ref, coordinates_t *dst, nod
     history_t *h;
 
     for (h = history_needle; h != NULL; h = (hdi == HISTORY_OLDER ? h->prev : h->next)) {
-        if (!h->latest || h->loc.node == NULL || h->loc.node == ref->node ||
+        if (h->loc.node == NULL || h->loc.node == ref->node ||
             h->loc.node->hidden || !node_matches(&h->loc, ref, sel))
                 continue;
 
@@ -267,7 +377,7 @@ history_find_desktop(history_dir_t hdl, coordinates_t *ref, coordinates_t *dst,
     history_t *h;
 
     for (h = history_needle; h != NULL; h = (hdi == HISTORY_OLDER ? h->prev : h->next)) {
-        if (!h->latest || h->loc.desktop == ref->desktop || !desktop_matches(&h->loc, ref, sel))
+        if (h->loc.desktop == ref->desktop || !desktop_matches(&h->loc, ref, sel))
             continue;
 
         if (!record_history)
@@ -305,7 +415,7 @@ history_find_monitor(history_dir_t hdi, coordinates_t *ref, coordinates_t *dst,
     history_t *h;
 
     for (h = history_needle; h != NULL; h = (hdi == HISTORY_OLDER ? h->prev : h->next)) {
-        if (!h->latest || h->loc.monitor == ref->monitor || !monitor_matches(&h->loc, ref, sel))
+        if (h->loc.monitor == ref->monitor || !monitor_matches(&h->loc, ref, sel))
             continue;
 
         if (!record_history)
@@ -319,19 +429,12 @@ history_find_monitor(history_dir_t hdi, coordinates_t *ref, coordinates_t *dst,
     return false;
 }
 
-uint32_t
+/* Lower for more recent nodes, only meant to be compared. */
+uint64_t
 history_rank(node_t *n)
 {
-    uint32_t r = 0;
-    history_t *h = history_tail;
+    if (n->hist == NULL)
+        return UINT64_MAX;
 
-    while (h != NULL && (!h->latest || h->loc.node != n)) {
-        h = h->prev;
-        r++;
-    }
-
-    if (h == NULL)
-        return UINT32_MAX;
-    else
-        return r;
+    return UINT64_MAX - 1 - n->hist->order;
 }
@@ -0,0 +1,231 @@
+/**
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/index.c }
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * See the file LICENSE for details.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lowm.h"
+#include "tree.h"
+#include "index.h"
+
+typedef struct {
+    uint32_t id;
+    coordinates_t loc;
+} index_entry_t;
+
+/**
+ * Open addressing with linear probing; an id of XCB_NONE marks a free slot.
+**/
+static index_entry_t *entries = NULL;
+static size_t capacity = 0;
+static size_t count = 0;
+
+static inline size_t
+index_slot(uint32_t id)
+{
+    return (size_t) ((id * 2654435761u) & (capacity - 1));
+}
+
+static void
+index_grow(void)
+{
+    index_entry_t *old = entries;
+    size_t old_capacity = capacity;
+
+    capacity = (capacity == 0 ? INDEX_INIT_CAP : capacity * 2);
+    entries = calloc(capacity, sizeof(index_entry_t));
+
+    if (entries == NULL) {
+        perror("index: calloc");
+        entries = old;
+        capacity = old_capacity;
+
+        return;
+    }
+
+    count = 0;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].id == XCB_NONE)
+            continue;
+
+        size_t j = index_slot(old[i].id);
+
+        while (entries[j].id != XCB_NONE)
+            j = (j + 1) & (capacity - 1);
+
+        entries[j] = old[i];
+        count++;
+    }
+
+    free(old);
+}
+
+static void
+index_put(uint32_t id, coordinates_t loc)
+{
+    if (id == XCB_NONE)
+        return;
+
+    if (2 * (count + 1) > capacity)
+        index_grow();
+
+    if (capacity == 0)
+        return;
+
+    size_t i = index_slot(id);
+
+    while (entries[i].id != XCB_NONE && entries[i].id != id)
+        i = (i + 1) & (capacity - 1);
+
+    if (entries[i].id == XCB_NONE)
+        count++;
+
+    entries[i].id = id;
+    entries[i].loc = loc;
+}
+
+static index_entry_t *
+index_get(uint32_t id)
+{
+    if (capacity == 0 || id == XCB_NONE)
+        return NULL;
+
+    size_t i = index_slot(id);
+
+    while (entries[i].id != XCB_NONE) {
+        if (entries[i].id == id)
+            return &entries[i];
+
+        i = (i + 1) & (capacity - 1);
+    }
+
+    return NULL;
+}
+
+static void
+index_del(uint32_t id)
+{
+    index_entry_t *e = index_get(id);
+
+    if (e == NULL)
+        return;
+
+    /* Shift the following entries of the cluster back instead of leaving tombstones. */
+    size_t i = e - entries;
+    size_t j = i;
+
+    for (;;) {
+        j = (j + 1) & (capacity - 1);
+
+        if (entries[j].id == XCB_NONE)
+            break;
+
+        size_t k = index_slot(entries[j].id);
+
+        if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+            entries[i] = entries[j];
+            i = j;
+        }
+    }
+
+    entries[i].id = XCB_NONE;
+    count--;
+}
+
+void
+index_add(monitor_t *m, desktop_t *d, node_t *n)
+{
+    if (n == NULL)
+        return;
+
+    coordinates_t loc = {m, d, n};
+
+    index_put(n->id, loc);
+}
+
+void
+index_add_in(monitor_t *m, desktop_t *d, node_t *n)
+{
+    if (n == NULL)
+        return;
+
+    index_add(m, d, n);
+    index_add_in(m, d, n->first_child);
+    index_add_in(m, d, n->second_child);
+}
+
+void
+index_remove(node_t *n)
+{
+    if (n == NULL)
+        return;
+
+    index_entry_t *e = index_get(n->id);
+
+    /* Only drop the entry if it still refers to this very node. */
+    if (e != NULL && e->loc.node == n)
+        index_del(n->id);
+}
+
+void
+index_remove_in(node_t *n)
+{
+    if (n == NULL)
+        return;
+
+    index_remove(n);
+    index_remove_in(n->first_child);
+    index_remove_in(n->second_child);
+}
+
+void
+index_rekey(uint32_t old_id, uint32_t new_id)
+{
+    index_entry_t *e = index_get(old_id);
+
+    if (e == NULL)
+        return;
+
+    coordinates_t loc = e->loc;
+
+    index_del(old_id);
+    index_put(new_id, loc);
+}
+
+bool
+index_find(uint32_t id, coordinates_t *loc)
+{
+    index_entry_t *e = index_get(id);
+
+    if (e == NULL)
+        return false;
+
+    *loc = e->loc;
+
+    return true;
+}
+
+void
+index_rebuild(void)
+{
+    index_clear();
+
+    for (monitor_t *m = mon_head; m != NULL; m = m->next) {
+        for (desktop_t *d = m->desk_head; d != NULL; d = d->next)
+            index_add_in(m, d, d->root);
+    }
+}
+
+void
+index_clear(void)
+{
+    free(entries);
+    entries = NULL;
+    capacity = count = 0;
+}
@@ -0,0 +1,28 @@
+/**
+ * LOWM: An advanced tiling window manager for Unix.
+ *
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/index.h }.
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * Refer to the file LICENSE for additional details.
+**/
+
+#ifndef LOWM_INDEX_H
+#define LOWM_INDEX_H
+
+#define INDEX_INIT_CAP 64
+
+/**
+ * Map node ids (window ids for leaves holding a client) to their
+ * coordinates, so that resolving an id doesn't need to walk every
+ * monitor, desktop and tree.
+**/
+void index_add(monitor_t *m, desktop_t *d, node_t *n);
+void index_add_in(monitor_t *m, desktop_t *d, node_t *n);
+void index_remove(node_t *n);
+void index_remove_in(node_t *n);
+void index_rekey(uint32_t old_id, uint32_t new_id);
+bool index_find(uint32_t id, coordinates_t *loc);
+void index_rebuild(void);
+void index_clear(void);
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/intern.c }
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * See the file LICENSE for details.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lowm.h"
+#include "intern.h"
+
+/**
+ * Entries are indexed by their ids, and chained through `next` either in
+ * their hash bucket or, once released, in the list of ids to reuse. There
+ * are as many buckets as entries.
+**/
+static intern_entry_t *entries = NULL;
+static uint32_t *buckets = NULL;
+static uint32_t cap = 0;
+static uint32_t used = 1;
+static uint32_t free_ids = 0;
+
+static bool
+intern_grow(void)
+{
+    uint32_t n = (cap == 0 ? INTERN_INIT_CAP : cap * 2);
+    intern_entry_t *e = realloc(entries, n * sizeof(intern_entry_t));
+
+    if (e == NULL) {
+        perror("intern: realloc");
+
+        return false;
+    }
+
+    entries = e;
+    uint32_t *b = calloc(n, sizeof(uint32_t));
+
+    if (b == NULL) {
+        perror("intern: calloc");
+
+        return false;
+    }
+
+    free(buckets);
+    buckets = b;
+    cap = n;
+
+    /* Released entries have no string, and are already on the free list. */
+    for (uint32_t id = 1; id < used; id++) {
+        if (entries[id].str == NULL)
+            continue;
+
+        uint32_t *slot = &buckets[entries[id].hash & (cap - 1)];
+        entries[id].next = *slot;
+        *slot = id;
+    }
+
+    return true;
+}
+
+uint32_t
+intern_find(const char *s)
+{
+    if (s == NULL || *s == '\0' || cap == 0)
+        return 0;
+
+    uint32_t h = hash_string(s);
+
+    for (uint32_t id = buckets[h & (cap - 1)]; id != 0; id = entries[id].next) {
+        if (entries[id].hash == h && streq(entries[id].str, s))
+            return id;
+    }
+
+    return 0;
+}
+
+uint32_t
+intern(const char *s)
+{
+    uint32_t id = intern_find(s);
+
+    if (id != 0 || s == NULL || *s == '\0')
+        return intern_retain(id);
+
+    char *str = strdup(s);
+
+    if (str == NULL) {
+        perror("intern: strdup");
+
+        return 0;
+    }
+
+    if (free_ids != 0) {
+        id = free_ids;
+        free_ids = entries[id].next;
+    } else if (used < cap || intern_grow()) {
+        id = used++;
+    } else {
+        free(str);
+
+        return 0;
+    }
+
+    intern_entry_t *e = &entries[id];
+    uint32_t *slot;
+
+    e->str = str;
+    e->hash = hash_string(s);
+    e->refs = 1;
+    slot = &buckets[e->hash & (cap - 1)];
+    e->next = *slot;
+    *slot = id;
+
+    return id;
+}
+
+uint32_t
+intern_retain(uint32_t id)
+{
+    if (id != 0)
+        entries[id].refs++;
+
+    return id;
+}
+
+void
+intern_release(uint32_t id)
+{
+    if (id == 0 || --entries[id].refs > 0)
+        return;
+
+    intern_entry_t *e = &entries[id];
+    uint32_t *slot = &buckets[e->hash & (cap - 1)];
+
+    while (*slot != id)
+        slot = &entries[*slot].next;
+
+    *slot = e->next;
+    free(e->str);
+    e->str = NULL;
+    e->next = free_ids;
+    free_ids = id;
+}
+
+const char *
+intern_str(uint32_t id)
+{
+    return (id == 0 ? "" : entries[id].str);
+}
@@ -0,0 +1,34 @@
+/**
+ * LOWM: An advanced tiling window manager for Unix.
+ *
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/intern.h }.
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * Refer to the file LICENSE for additional details.
+**/
+
+#ifndef LOWM_INTERN_H
+#define LOWM_INTERN_H
+
+#define INTERN_INIT_CAP 64
+
+typedef struct {
+    char *str;
+    uint32_t hash;
+    uint32_t refs;
+    uint32_t next;
+} intern_entry_t;
+
+/**
+ * Class and instance names are kept once, in a table shared by clients
+ * and rules, and stand for themselves as ids: two names are equal if and
+ * only if their ids are. Each holder takes a reference and gives it back
+ * when it's done, and a name goes away with its last reference. The id
+ * 0 is never handed out, and stands for the empty name.
+**/
+uint32_t intern(const char *s);
+uint32_t intern_find(const char *s);
+uint32_t intern_retain(uint32_t id);
+void intern_release(uint32_t id);
+const char *intern_str(uint32_t id);
+
+#endif
@@ -0,0 +1,550 @@
+/**
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/ipc.c }
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * See the file LICENSE for details.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "lowm.h"
+#include "batch.h"
+#include "loop.h"
+#include "messages.h"
+#include "common.h"
+#include "ipc.h"
+
+/* Ordered by last activity: the head is always the next one to time out. */
+static ipc_client_t *client_head = NULL;
+static ipc_client_t *client_tail = NULL;
+
+/* The client whose message is being processed. */
+static ipc_client_t *serving = NULL;
+
+static ipc_client_t *
+make_ipc_client(void)
+{
+    ipc_client_t *ic = calloc(1, sizeof(ipc_client_t));
+
+    if (ic == NULL) {
+        perror("ipc: calloc");
+
+        return NULL;
+    }
+
+    ic->source = NULL;
+    ic->in = ic->out = NULL;
+    ic->in_len = ic->in_cap = 0;
+    ic->out_len = ic->out_pos = ic->out_cap = 0;
+    ic->deadline = 0;
+    ic->opened = ic->session = ic->eof = ic->detached = false;
+    ic->batch = (batch_t) { 0, 0, 0, NULL, 0, 0 };
+    ic->prev = ic->next = NULL;
+
+    return ic;
+}
+
+static void
+ipc_unlink(ipc_client_t *ic)
+{
+    ipc_client_t *a = ic->prev;
+    ipc_client_t *b = ic->next;
+
+    if (a != NULL)
+        a->next = b;
+
+    if (b != NULL)
+        b->prev = a;
+
+    if (ic == client_head)
+        client_head = b;
+
+    if (ic == client_tail)
+        client_tail = a;
+
+    ic->prev = ic->next = NULL;
+}
+
+static void
+ipc_touch(ipc_client_t *ic)
+{
+    /**
+     * A session waiting for its next command is idle by choice, it never
+     * times out unless it holds a batch open.
+    **/
+    if (ic->session && !ic->eof && ic->batch.depth == 0 && ic->in_len == 0 &&
+        ic->out_pos == ic->out_len) {
+        ipc_unlink(ic);
+
+        return;
+    }
+
+    uint64_t deadline = monotonic_ms() + IPC_IDLE_TIMEOUT;
+
+    if (ic->batch.depth > 0 && ic->batch.deadline < deadline)
+        deadline = ic->batch.deadline;
+
+    ipc_unlink(ic);
+    ic->deadline = deadline;
+
+    /* Deadlines mostly grow, the place is found from the tail. */
+    ipc_client_t *a = client_tail;
+
+    while (a != NULL && a->deadline > deadline)
+        a = a->prev;
+
+    ic->prev = a;
+    ic->next = (a != NULL ? a->next : client_head);
+
+    if (ic->next != NULL)
+        ic->next->prev = ic;
+    else
+        client_tail = ic;
+
+    if (a != NULL)
+        a->next = ic;
+    else
+        client_head = ic;
+}
+
+static bool
+ipc_queue(ipc_client_t *ic, char *buf, size_t len, bool terminate)
+{
+    size_t need = ic->out_len + len + (terminate ? 1 : 0);
+
+    if (need > ic->out_cap) {
+        size_t cap = (ic->out_cap == 0 ? BUFSIZ : ic->out_cap);
+
+        while (cap < need)
+            cap *= 2;
+
+        char *out = realloc(ic->out, cap);
+
+        if (out == NULL) {
+            perror("ipc: realloc");
+
+            return false;
+        }
+
+        ic->out = out;
+        ic->out_cap = cap;
+    }
+
+    memcpy(ic->out + ic->out_len, buf, len);
+    ic->out_len += len;
+
+    if (terminate)
+        ic->out[ic->out_len++] = '\0';
+
+    return true;
+}
+
+/* Commit the batches a client left open, on its behalf. */
+static void
+ipc_end_batch(ipc_client_t *ic)
+{
+    batch_t *prev = batch_enter(&ic->batch);
+
+    while (ic->batch.depth > 0)
+        batch_commit();
+
+    batch_enter(prev);
+}
+
+static bool
+ipc_run(ipc_client_t *ic, char *msg, size_t msg_len)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *rsp = open_memstream(&buf, &len);
+
+    if (rsp == NULL) {
+        perror("ipc: open_memstream");
+
+        return false;
+    }
+
+    batch_t *prev = batch_enter(&ic->batch);
+
+    serving = ic;
+    handle_message(msg, msg_len, rsp);
+    serving = NULL;
+    batch_enter(prev);
+    fclose(rsp);
+
+    bool ret = ipc_queue(ic, buf, len, ic->session);
+    free(buf);
+
+    return ret;
+}
+
+static void ipc_write(ipc_client_t *ic);
+
+/**
+ * Measure the command at the start of a session's input: its argument
+ * count, then its arguments. Returns the size of the whole command, 0 if
+ * it isn't complete yet and -1 if it's malformed. The arguments start at
+ * *args.
+**/
+static ssize_t
+session_frame(char *in, size_t len, size_t *args)
+{
+    char *nul = memchr(in, '\0', len);
+
+    if (nul == NULL)
+        return (len > SESSION_COUNT_MAX ? -1 : 0);
+
+    char *end;
+    unsigned long num = strtoul(in, &end, 10);
+
+    if (end == in || end != nul || num == 0 || num > IPC_MAX_MESSAGE)
+        return -1;
+
+    size_t i = nul - in + 1;
+
+    *args = i;
+
+    for (; num > 0; num--) {
+        if ((nul = memchr(in + i, '\0', len - i)) == NULL)
+            return 0;
+
+        i = nul - in + 1;
+    }
+
+    return i;
+}
+
+/**
+ * Run every complete command of a session, unless the client lets its
+ * replies pile up, in which case we stop reading from it until they have
+ * been sent.
+**/
+static void
+ipc_dispatch(ipc_client_t *ic)
+{
+    size_t start = 0;
+
+    while (start < ic->in_len && ic->out_len - ic->out_pos < IPC_MAX_PENDING) {
+        size_t args = 0;
+        ssize_t size = session_frame(ic->in + start, ic->in_len - start, &args);
+
+        if (size == 0)
+            break;
+
+        if (size == -1 || !ipc_run(ic, ic->in + start + args, size - args)) {
+            ipc_close(ic);
+
+            return;
+        }
+
+        start += size;
+    }
+
+    if (start > 0) {
+        memmove(ic->in, ic->in + start, ic->in_len - start);
+        ic->in_len -= start;
+    }
+
+    if (ic->out_pos < ic->out_len)
+        ipc_write(ic);
+    else if (ic->eof)
+        ipc_close(ic);
+    else
+        ipc_touch(ic);
+}
+
+static void
+ipc_write(ipc_client_t *ic)
+{
+    while (ic->out_pos < ic->out_len) {
+        ssize_t n = send(ic->source->fd, ic->out + ic->out_pos, ic->out_len - ic->out_pos,
+            MSG_NOSIGNAL);
+
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                bool throttled = (ic->out_len - ic->out_pos >= IPC_MAX_PENDING);
+
+                loop_modify(ic->source, EPOLLOUT | (ic->session && !ic->eof && !throttled ?
+                    EPOLLIN : 0));
+                ipc_touch(ic);
+
+                return;
+            }
+
+            ipc_close(ic);
+
+            return;
+        }
+
+        ic->out_pos += n;
+    }
+
+    ic->out_pos = ic->out_len = 0;
+
+    /* Commands held back while the replies were piling up. */
+    if (ic->session && ic->in_len > 0) {
+        if (!ic->eof)
+            loop_modify(ic->source, EPOLLIN);
+
+        ipc_dispatch(ic);
+
+        return;
+    }
+
+    /* The reply is complete, closing the connection marks its end. */
+    if (!ic->session || ic->eof) {
+        ipc_close(ic);
+
+        return;
+    }
+
+    loop_modify(ic->source, EPOLLIN);
+    ipc_touch(ic);
+}
+
+static void
+ipc_reply(ipc_client_t *ic)
+{
+    if (ic->in_len == 0) {
+        ipc_close(ic);
+
+        return;
+    }
+
+    ic->in[ic->in_len] = '\0';
+
+    if (!ipc_run(ic, ic->in, ic->in_len) || ic->detached) {
+        ipc_close(ic);
+
+        return;
+    }
+
+    free(ic->in);
+    ic->in = NULL;
+    ic->in_len = ic->in_cap = 0;
+
+    ipc_write(ic);
+}
+
+static void
+ipc_read(ipc_client_t *ic)
+{
+    for (;;) {
+        if (ic->in_cap - ic->in_len < BUFSIZ) {
+            size_t cap = (ic->in_cap == 0 ? BUFSIZ : 2 * ic->in_cap);
+
+            if (cap > IPC_MAX_MESSAGE + 1) {
+                warn("[!] WARNING: lowm: Dropping a message longer than %i bytes\n",
+                    IPC_MAX_MESSAGE);
+                ipc_close(ic);
+
+                return;
+            }
+
+            char *in = realloc(ic->in, cap);
+
+            if (in == NULL) {
+                perror("ipc: realloc");
+                ipc_close(ic);
+
+                return;
+            }
+
+            ic->in = in;
+            ic->in_cap = cap;
+        }
+
+        /* Keep a byte for the terminating null character. */
+        ssize_t n = recv(ic->source->fd, ic->in + ic->in_len, ic->in_cap - ic->in_len - 1, 0);
+
+        if (n > 0) {
+            if (!ic->opened) {
+                ic->opened = true;
+
+                if (ic->in[0] == SESSION_MESSAGE[0]) {
+                    ic->session = true;
+                    memmove(ic->in, ic->in + 1, --n);
+                }
+            }
+
+            ic->in_len += n;
+
+            if (ic->session) {
+                ipc_dispatch(ic);
+
+                return;
+            }
+
+            ipc_touch(ic);
+        } else if (n == 0) {
+            ic->eof = true;
+
+            /* The client shut down its writing end: the message is complete. */
+            if (ic->session)
+                ipc_dispatch(ic);
+            else
+                ipc_reply(ic);
+
+            return;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return;
+        } else if (errno != EINTR) {
+            ipc_close(ic);
+
+            return;
+        }
+    }
+}
+
+bool
+ipc_listen(int sock_fd)
+{
+    int flags = fcntl(sock_fd, F_GETFL, 0);
+
+    if (flags == -1 || fcntl(sock_fd, F_SETFL, flags | O_NONBLOCK) == -1)
+        return false;
+
+    return (loop_add(sock_fd, EPOLLIN, ipc_accept, NULL) != NULL);
+}
+
+void
+ipc_accept(event_source_t *src, uint32_t events)
+{
+    int cli_fd;
+
+    while ((cli_fd = accept4(src->fd, NULL, 0, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        ipc_client_t *ic = make_ipc_client();
+
+        if (ic == NULL) {
+            close(cli_fd);
+            continue;
+        }
+
+        if ((ic->source = loop_add(cli_fd, EPOLLIN, ipc_handle, ic)) == NULL) {
+            close(cli_fd);
+            free(ic);
+            continue;
+        }
+
+        ipc_touch(ic);
+    }
+}
+
+void
+ipc_handle(event_source_t *src, uint32_t events)
+{
+    ipc_client_t *ic = src->data;
+
+    if (ic->out_pos < ic->out_len && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        ipc_write(ic);
+
+        /* The connection might be gone by now. */
+        if (src->handler == NULL)
+            return;
+    }
+
+    if ((ic->out_pos == ic->out_len || ic->session) && (events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+        ipc_read(ic);
+}
+
+int
+ipc_timeout(void)
+{
+    if (client_head == NULL)
+        return -1;
+
+    uint64_t now = monotonic_ms();
+
+    if (client_head->deadline <= now)
+        return 0;
+
+    return (int) (client_head->deadline - now);
+}
+
+void
+ipc_expire(void)
+{
+    uint64_t now = monotonic_ms();
+
+    while (client_head != NULL && client_head->deadline <= now) {
+        ipc_client_t *ic = client_head;
+
+        if (ic->batch.depth > 0 && ic->batch.deadline <= now) {
+            warn("[!] WARNING: lowm: Committing a batch left open for too long\n");
+            ipc_end_batch(ic);
+            ipc_touch(ic);
+            continue;
+        }
+
+        /**
+         * Clients predating the shutdown of the writing end never signal
+         * the end of their message: answer them once they went quiet.
+        **/
+        if (!ic->session && ic->out_len == 0 && ic->in_len > 0 && ic->in[ic->in_len - 1] == '\0')
+            ipc_reply(ic);
+        else
+            ipc_close(ic);
+    }
+}
+
+/**
+ * Hand the connection of the client being served over to the caller, who
+ * then owns its descriptor. Sessions keep their connection. Subscribers
+ * are restored from their descriptors after a restart, so this one has to
+ * survive the exec.
+**/
+int
+ipc_detach(void)
+{
+    if (serving == NULL || serving->session || serving->source == NULL)
+        return -1;
+
+    int fd = serving->source->fd;
+
+    loop_remove(serving->source);
+    serving->source = NULL;
+    serving->detached = true;
+    fcntl(fd, F_SETFD, fcntl(fd, F_GETFD, 0) & ~FD_CLOEXEC);
+
+    return fd;
+}
+
+void
+ipc_close(ipc_client_t *ic)
+{
+    if (ic == NULL)
+        return;
+
+    ipc_unlink(ic);
+
+    /* A batch left open by a client going away is committed on its behalf. */
+    ipc_end_batch(ic);
+    free(ic->batch.desktops);
+
+    if (ic->source != NULL) {
+        int fd = ic->source->fd;
+
+        loop_remove(ic->source);
+        close(fd);
+    }
+
+    free(ic->in);
+    free(ic->out);
+    free(ic);
+}
+
+void
+ipc_close_all(void)
+{
+    while (client_head != NULL)
+        ipc_close(client_head);
+}
@@ -0,0 +1,35 @@
+/**
+ * LOWM: An advanced tiling window manager for Unix.
+ *
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/ipc.h }.
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * Refer to the file LICENSE for additional details.
+**/
+
+#ifndef LOWM_IPC_H
+#define LOWM_IPC_H
+
+#define IPC_IDLE_TIMEOUT 2000
+#define IPC_MAX_MESSAGE (1 << 20)
+#define IPC_MAX_PENDING (1 << 20)
+
+/**
+ * A client sends its NUL separated arguments, shuts down its writing end
+ * and reads the reply until the server closes the connection. Nothing is
+ * ever read or written on a client socket unless the loop said it would
+ * not block, and a client making no progress for IPC_IDLE_TIMEOUT
+ * milliseconds is dropped.
+ *
+ * A session (see SESSION_MESSAGE) instead pipelines as many commands as
+ * the client wants over the same connection, with one framed reply each.
+**/
+bool ipc_listen(int sock_fd);
+void ipc_accept(event_source_t *src, uint32_t events);
+void ipc_handle(event_source_t *src, uint32_t events);
+int ipc_timeout(void);
+void ipc_expire(void);
+int ipc_detach(void);
+void ipc_close(ipc_client_t *ic);
+void ipc_close_all(void);
+
+#endif
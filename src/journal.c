@@ -0,0 +1,253 @@
+/**
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/journal.c }
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * See the file LICENSE for details.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lowm.h"
+#include "journal.h"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t first_seq;
+    uint64_t next_seq;
+    uint64_t head;
+    uint64_t used;
+} journal_header_t;
+
+typedef struct {
+    uint64_t seq;
+    uint32_t mask;
+    uint32_t len;
+    uint32_t ids[3];
+    uint32_t depth;
+} journal_record_t;
+
+static journal_header_t *header = NULL;
+static char *ring = NULL;
+static char *journal_path = NULL;
+
+/* Sequence numbers keep increasing even when there is no journal to write to. */
+static uint64_t next_seq = 1;
+
+static inline size_t
+record_size(size_t len)
+{
+    return (sizeof(journal_record_t) + len + 7) & ~((size_t) 7);
+}
+
+static void
+ring_write(uint64_t off, void *src, size_t len)
+{
+    size_t first = (len < header->capacity - off ? len : header->capacity - off);
+
+    memcpy(ring + off, src, first);
+    memcpy(ring, (char *) src + first, len - first);
+}
+
+static void
+ring_read(uint64_t off, void *dst, size_t len)
+{
+    size_t first = (len < header->capacity - off ? len : header->capacity - off);
+
+    memcpy(dst, ring + off, first);
+    memcpy((char *) dst + first, ring, len - first);
+}
+
+static void
+journal_reset(void)
+{
+    memset(header, 0, sizeof(journal_header_t));
+    header->magic = JOURNAL_MAGIC;
+    header->version = JOURNAL_VERSION;
+    header->capacity = JOURNAL_SIZE;
+    header->first_seq = header->next_seq = next_seq;
+    header->head = header->used = 0;
+}
+
+/* A journal left behind by a crash is only trusted if its header is consistent. */
+static bool
+journal_valid(void)
+{
+    return (header->magic == JOURNAL_MAGIC && header->version == JOURNAL_VERSION &&
+            header->capacity == JOURNAL_SIZE && header->head < header->capacity &&
+            header->used <= header->capacity && header->first_seq <= header->next_seq &&
+            header->next_seq > 0);
+}
+
+bool
+journal_open(char *path)
+{
+    size_t size = sizeof(journal_header_t) + JOURNAL_SIZE;
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    struct stat st;
+
+    if (fd == -1) {
+        perror("journal: open");
+
+        return false;
+    }
+
+    if (fstat(fd, &st) == -1 || ((size_t) st.st_size != size && ftruncate(fd, size) == -1)) {
+        perror("journal: ftruncate");
+        close(fd);
+
+        return false;
+    }
+
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        perror("journal: mmap");
+
+        return false;
+    }
+
+    header = addr;
+    ring = (char *) addr + sizeof(journal_header_t);
+    journal_path = strdup(path);
+
+    if (!journal_valid())
+        journal_reset();
+
+    next_seq = header->next_seq;
+
+    return true;
+}
+
+uint64_t
+journal_append(int mask, uint32_t *ids, int depth, char *data, size_t len)
+{
+    uint64_t seq = next_seq++;
+
+    if (header == NULL)
+        return seq;
+
+    size_t size = record_size(len);
+    header->next_seq = next_seq;
+
+    /* Wouldn't fit even alone: whoever missed it can't resume. */
+    if (size > header->capacity) {
+        header->head = header->used = 0;
+        header->first_seq = next_seq;
+
+        return seq;
+    }
+
+    while (header->used + size > header->capacity) {
+        journal_record_t old;
+
+        ring_read(header->head, &old, sizeof(old));
+        header->head = (header->head + record_size(old.len)) % header->capacity;
+        header->used -= record_size(old.len);
+        header->first_seq = old.seq + 1;
+    }
+
+    if (header->used == 0)
+        header->first_seq = seq;
+
+    journal_record_t rec = { seq, mask, len, { 0, 0, 0 }, depth };
+
+    memcpy(rec.ids, ids, sizeof(rec.ids));
+
+    uint64_t tail = (header->head + header->used) % header->capacity;
+
+    ring_write(tail, &rec, sizeof(rec));
+    ring_write((tail + sizeof(rec)) % header->capacity, data, len);
+    header->used += size;
+
+    return seq;
+}
+
+/* The sequence number the next event will get. */
+uint64_t
+journal_next_seq(void)
+{
+    return next_seq;
+}
+
+/* Tell whether every event following the given one is still in the journal. */
+bool
+journal_covers(uint64_t after)
+{
+    if (header == NULL)
+        return false;
+
+    return (after + 1 >= header->first_seq && after < header->next_seq);
+}
+
+bool
+journal_replay(uint64_t after, journal_visitor_t visit, void *arg)
+{
+    if (!journal_covers(after))
+        return false;
+
+    uint64_t off = header->head;
+    uint64_t left = header->used;
+    char *buf = NULL;
+    size_t cap = 0;
+    bool ret = true;
+    bool more = true;
+
+    while (left > 0 && more) {
+        journal_record_t rec;
+
+        ring_read(off, &rec, sizeof(rec));
+
+        if (rec.seq > after) {
+            if (rec.len + 1 > cap) {
+                char *tmp = realloc(buf, rec.len + 1);
+
+                if (tmp == NULL) {
+                    perror("journal: realloc");
+                    ret = false;
+                    break;
+                }
+
+                buf = tmp;
+                cap = rec.len + 1;
+            }
+
+            ring_read((off + sizeof(rec)) % header->capacity, buf, rec.len);
+            buf[rec.len] = '\0';
+            more = visit(rec.seq, rec.mask, rec.ids, rec.depth, buf, rec.len, arg);
+        }
+
+        off = (off + record_size(rec.len)) % header->capacity;
+        left -= record_size(rec.len);
+    }
+
+    free(buf);
+
+    return ret;
+}
+
+void
+journal_close(void)
+{
+    if (header == NULL)
+        return;
+
+    munmap(header, sizeof(journal_header_t) + JOURNAL_SIZE);
+    header = NULL;
+    ring = NULL;
+
+    /* The next instance picks up where this one left off. */
+    if (!restart && journal_path != NULL)
+        unlink(journal_path);
+
+    free(journal_path);
+    journal_path = NULL;
+}
@@ -0,0 +1,39 @@
+/**
+ * LOWM: An advanced tiling window manager for Unix.
+ *
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/journal.h }.
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * Refer to the file LICENSE for additional details.
+**/
+
+#ifndef LOWM_JOURNAL_H
+#define LOWM_JOURNAL_H
+
+#define JOURNAL_MAGIC 0x6c6a726e
+#define JOURNAL_VERSION 1
+#define JOURNAL_SIZE (1 << 20)
+
+/**
+ * Every event sent to the subscribers is appended to a ring of
+ * JOURNAL_SIZE bytes mapped from a file, along with its sequence number
+ * and the ids of the objects it is about. The oldest events make room for
+ * the new ones, and the file outlives a restart so that subscribers can
+ * catch up on what they missed in the meantime.
+**/
+typedef bool (*journal_visitor_t)(uint64_t seq, int mask, uint32_t *ids, int depth, char *data,
+    size_t len, void *arg);
+
+bool journal_open(char *path);
+uint64_t journal_append(int mask, uint32_t *ids, int depth, char *data, size_t len);
+uint64_t journal_next_seq(void);
+bool journal_covers(uint64_t after);
+
+/**
+ * Visit the events following the given one, oldest first, until the
+ * visitor returns false. Only fails if they aren't all in the journal
+ * anymore.
+**/
+bool journal_replay(uint64_t after, journal_visitor_t visit, void *arg);
+void journal_close(void);
+
+#endif
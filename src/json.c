@@ -0,0 +1,186 @@
+/**
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/json.c }
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * See the file LICENSE for details.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lowm.h"
+#include "json.h"
+
+static void
+json_flush(json_writer_t *jw)
+{
+    if (jw->len > 0 && !jw->failed && fwrite(jw->buf, 1, jw->len, jw->out) != jw->len)
+        jw->failed = true;
+
+    jw->len = 0;
+}
+
+/* Make room for n more bytes, handing what's there over once it's a full chunk. */
+static bool
+json_reserve(json_writer_t *jw, size_t n)
+{
+    if (jw->failed)
+        return false;
+
+    if (jw->len >= JSON_CHUNK)
+        json_flush(jw);
+
+    if (jw->len + n <= jw->cap)
+        return true;
+
+    size_t cap = (jw->cap == 0 ? JSON_INIT_CAP : jw->cap);
+
+    while (cap < jw->len + n)
+        cap *= 2;
+
+    char *buf = realloc(jw->buf, cap);
+
+    if (buf == NULL) {
+        perror("json: realloc");
+        jw->failed = true;
+
+        return false;
+    }
+
+    jw->buf = buf;
+    jw->cap = cap;
+
+    return true;
+}
+
+static void
+json_append(json_writer_t *jw, const char *s, size_t n)
+{
+    if (!json_reserve(jw, n))
+        return;
+
+    memcpy(jw->buf + jw->len, s, n);
+    jw->len += n;
+}
+
+void
+json_init(json_writer_t *jw, FILE *out)
+{
+    jw->out = out;
+    jw->buf = NULL;
+    jw->len = jw->cap = 0;
+    jw->failed = false;
+}
+
+bool
+json_finish(json_writer_t *jw)
+{
+    json_flush(jw);
+    free(jw->buf);
+    jw->buf = NULL;
+    jw->cap = 0;
+
+    return !jw->failed;
+}
+
+void
+json_raw(json_writer_t *jw, const char *s)
+{
+    json_append(jw, s, strlen(s));
+}
+
+void
+json_char(json_writer_t *jw, char c)
+{
+    if (!json_reserve(jw, 1))
+        return;
+
+    jw->buf[jw->len++] = c;
+}
+
+void
+json_uint(json_writer_t *jw, uint64_t v)
+{
+    char digits[20];
+    int i = sizeof(digits);
+
+    do {
+        digits[--i] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+
+    json_append(jw, digits + i, sizeof(digits) - i);
+}
+
+void
+json_int(json_writer_t *jw, int64_t v)
+{
+    if (v < 0) {
+        json_char(jw, '-');
+        json_uint(jw, -(uint64_t) v);
+    } else {
+        json_uint(jw, v);
+    }
+}
+
+/* Ratios are the only floating point values, as printed by "%lf". */
+void
+json_double(json_writer_t *jw, double v)
+{
+    char tmp[64];
+    int n = snprintf(tmp, sizeof(tmp), "%lf", v);
+
+    if (n > 0)
+        json_append(jw, tmp, (size_t) n < sizeof(tmp) ? (size_t) n : sizeof(tmp) - 1);
+}
+
+void
+json_bool(json_writer_t *jw, bool v)
+{
+    json_raw(jw, BOOL_STR(v));
+}
+
+/* Runs of plain characters are copied at once, only the others are escaped. */
+void
+json_string(json_writer_t *jw, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char *run = s;
+
+    json_char(jw, '"');
+
+    for (; *s != '\0'; s++) {
+        unsigned char c = *s;
+
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        json_append(jw, run, s - run);
+        run = s + 1;
+
+        if (c == '"' || c == '\\') {
+            char esc[] = { '\\', c };
+            json_append(jw, esc, 2);
+        } else if (c == '\n') {
+            json_append(jw, "\\n", 2);
+        } else if (c == '\t') {
+            json_append(jw, "\\t", 2);
+        } else {
+            char esc[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+            json_append(jw, esc, sizeof(esc));
+        }
+    }
+
+    json_append(jw, run, s - run);
+    json_char(jw, '"');
+}
+
+void
+json_key(json_writer_t *jw, const char *k)
+{
+    json_char(jw, '"');
+    json_raw(jw, k);
+    json_append(jw, "\":", 2);
+}
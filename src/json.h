@@ -0,0 +1,39 @@
+/**
+ * LOWM: An advanced tiling window manager for Unix.
+ *
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/json.h }.
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * Refer to the file LICENSE for additional details.
+**/
+
+#ifndef LOWM_JSON_H
+#define LOWM_JSON_H
+
+#define JSON_INIT_CAP 4096
+#define JSON_CHUNK (1 << 16)
+
+typedef struct {
+    FILE *out;
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool failed;
+} json_writer_t;
+
+/**
+ * Values are appended to a buffer without going through any format
+ * string, and the buffer is handed to the output stream in one piece, or
+ * in chunks of JSON_CHUNK bytes for larger documents.
+**/
+void json_init(json_writer_t *jw, FILE *out);
+bool json_finish(json_writer_t *jw);
+void json_raw(json_writer_t *jw, const char *s);
+void json_char(json_writer_t *jw, char c);
+void json_uint(json_writer_t *jw, uint64_t v);
+void json_int(json_writer_t *jw, int64_t v);
+void json_double(json_writer_t *jw, double v);
+void json_bool(json_writer_t *jw, bool v);
+void json_string(json_writer_t *jw, const char *s);
+void json_key(json_writer_t *jw, const char *k);
+
+#endif
@@ -0,0 +1,143 @@
+/**
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/loop.c }
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * See the file LICENSE for details.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "lowm.h"
+#include "loop.h"
+
+static int epoll_fd = -1;
+
+/**
+ * Sources removed while the ready list is being dispatched may still be
+ * referenced by events that come later in the same batch; they are only
+ * freed once the batch is done.
+**/
+static event_source_t *dead_sources = NULL;
+
+bool
+loop_init(void)
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epoll_fd == -1) {
+        perror("loop: epoll_create1");
+
+        return false;
+    }
+
+    return true;
+}
+
+event_source_t *
+loop_add(int fd, uint32_t events, source_handler_t handler, void *data)
+{
+    if (epoll_fd == -1 || fd < 0)
+        return NULL;
+
+    event_source_t *src = calloc(1, sizeof(event_source_t));
+
+    if (src == NULL) {
+        perror("loop: calloc");
+
+        return NULL;
+    }
+
+    src->fd = fd;
+    src->events = events;
+    src->handler = handler;
+    src->data = data;
+    src->next = NULL;
+
+    struct epoll_event ev = { .events = events, .data.ptr = src };
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        perror("loop: epoll_ctl");
+        free(src);
+
+        return NULL;
+    }
+
+    return src;
+}
+
+bool
+loop_modify(event_source_t *src, uint32_t events)
+{
+    if (src == NULL || src->handler == NULL)
+        return false;
+
+    if (src->events == events)
+        return true;
+
+    struct epoll_event ev = { .events = events, .data.ptr = src };
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, src->fd, &ev) == -1) {
+        perror("loop: epoll_ctl");
+
+        return false;
+    }
+
+    src->events = events;
+
+    return true;
+}
+
+void
+loop_remove(event_source_t *src)
+{
+    if (src == NULL || src->handler == NULL)
+        return;
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, src->fd, NULL);
+    src->handler = NULL;
+    src->next = dead_sources;
+    dead_sources = src;
+}
+
+int
+loop_wait(int timeout)
+{
+    struct epoll_event events[LOOP_MAX_EVENTS];
+    int n = epoll_wait(epoll_fd, events, LOOP_MAX_EVENTS, timeout);
+
+    if (n == -1 && errno != EINTR)
+        perror("loop: epoll_wait");
+
+    for (int i = 0; i < n; i++) {
+        event_source_t *src = events[i].data.ptr;
+
+        if (src->handler != NULL)
+            src->handler(src, events[i].events);
+    }
+
+    while (dead_sources != NULL) {
+        event_source_t *next = dead_sources->next;
+        free(dead_sources);
+        dead_sources = next;
+    }
+
+    return n;
+}
+
+void
+loop_close(void)
+{
+    if (epoll_fd != -1)
+        close(epoll_fd);
+
+    epoll_fd = -1;
+
+    while (dead_sources != NULL) {
+        event_source_t *next = dead_sources->next;
+        free(dead_sources);
+        dead_sources = next;
+    }
+}
@@ -0,0 +1,28 @@
+/**
+ * LOWM: An advanced tiling window manager for Unix.
+ *
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/loop.h }.
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * Refer to the file LICENSE for additional details.
+**/
+
+#ifndef LOWM_LOOP_H
+#define LOWM_LOOP_H
+
+#include <sys/epoll.h>
+
+#define LOOP_MAX_EVENTS 64
+
+/**
+ * Every file descriptor the window manager waits on is registered once
+ * with its own handler, so a wakeup only costs as much as the number of
+ * sources that are actually ready.
+**/
+bool loop_init(void);
+event_source_t *loop_add(int fd, uint32_t events, source_handler_t handler, void *data);
+bool loop_modify(event_source_t *src, uint32_t events);
+void loop_remove(event_source_t *src);
+int loop_wait(int timeout);
+void loop_close(void);
+
+#endif
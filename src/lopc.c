@@ -6,6 +6,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -15,12 +18,227 @@
 #include "helpers.h"
 #include "common.h"
 
+#define BATCH_MAX_PENDING (1 << 16)
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t pos;
+    size_t cap;
+} buffer_t;
+
+static void
+buffer_reserve(buffer_t *b, size_t len)
+{
+    if (b->len + len <= b->cap)
+        return;
+
+    size_t cap = (b->cap == 0 ? BUFSIZ : b->cap);
+
+    while (cap < b->len + len)
+        cap *= 2;
+
+    char *data = realloc(b->data, cap);
+
+    if (data == NULL)
+        lowm_err("[!] ERROR: lowm: Failed to grow a buffer\n");
+
+    b->data = data;
+    b->cap = cap;
+}
+
+static void
+buffer_shift(buffer_t *b)
+{
+    if (b->pos == 0)
+        return;
+
+    memmove(b->data, b->data + b->pos, b->len - b->pos);
+    b->len -= b->pos;
+    b->pos = 0;
+}
+
+/**
+ * Split a line of the batch in shell-like words: blanks separate the
+ * arguments, quotes and backslashes protect them and '#' starts a
+ * comment. The arguments are written NUL terminated into dst, preceded by
+ * their number (see SESSION_MESSAGE), so that "" is an argument like any
+ * other. Returns the number of arguments.
+**/
+static int
+split_command(const char *line, size_t len, buffer_t *dst)
+{
+    int num = 0;
+    size_t i = 0;
+    size_t start = dst->len;
+
+    buffer_reserve(dst, len + 1);
+
+    while (i < len) {
+        while (i < len && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r'))
+            i++;
+
+        if (i == len || line[i] == '#')
+            break;
+
+        char quote = 0;
+
+        while (i < len && (quote != 0 || (line[i] != ' ' && line[i] != '\t' && line[i] != '\r'))) {
+            char c = line[i++];
+
+            if (quote != 0 && c == quote) {
+                quote = 0;
+            } else if (quote == 0 && (c == '\'' || c == '"')) {
+                quote = c;
+            } else if (c == '\\' && quote != '\'' && i < len) {
+                dst->data[dst->len++] = line[i++];
+            } else {
+                dst->data[dst->len++] = c;
+            }
+        }
+
+        dst->data[dst->len++] = '\0';
+        num++;
+    }
+
+    if (num == 0)
+        return 0;
+
+    char count[SESSION_COUNT_MAX];
+    size_t n = snprintf(count, sizeof(count), "%i", num) + 1;
+
+    buffer_reserve(dst, n);
+    memmove(dst->data + start + n, dst->data + start, dst->len - start);
+    memcpy(dst->data + start, count, n);
+    dst->len += n;
+
+    return num;
+}
+
+/**
+ * Send every command read from the standard input over a single session,
+ * while printing the replies as they come back.
+**/
+static int
+run_batch(int sock_fd)
+{
+    buffer_t cmds = {0}, lines = {0}, replies = {0};
+    unsigned int sent = 0, received = 0;
+    bool input_done = false, shut = false;
+    int ret = EXIT_SUCCESS;
+
+    buffer_reserve(&cmds, 1);
+    cmds.data[cmds.len++] = SESSION_MESSAGE[0];
+
+    struct pollfd fds[] = {
+        { STDIN_FILENO, POLLIN, 0 },
+        { sock_fd, POLLIN, 0 },
+    };
+
+    while (!input_done || received < sent) {
+        fds[0].fd = (input_done || cmds.len - cmds.pos > BATCH_MAX_PENDING) ? -1 : STDIN_FILENO;
+        fds[1].events = POLLIN | (cmds.pos < cmds.len ? POLLOUT : 0);
+
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        if (fds[0].fd != -1 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+            buffer_reserve(&lines, BUFSIZ);
+            ssize_t n = read(STDIN_FILENO, lines.data + lines.len, lines.cap - lines.len);
+
+            if (n <= 0) {
+                input_done = true;
+
+                /* The last line might lack its newline. */
+                if (lines.len > lines.pos)
+                    sent += (split_command(lines.data + lines.pos, lines.len - lines.pos, &cmds) > 0);
+
+                lines.pos = lines.len;
+            } else {
+                lines.len += n;
+            }
+
+            char *nl;
+
+            while ((nl = memchr(lines.data + lines.pos, '\n', lines.len - lines.pos)) != NULL) {
+                size_t len = nl - (lines.data + lines.pos);
+
+                sent += (split_command(lines.data + lines.pos, len, &cmds) > 0);
+                lines.pos += len + 1;
+            }
+
+            buffer_shift(&lines);
+        }
+
+        if (fds[1].revents & POLLOUT) {
+            ssize_t n = send(sock_fd, cmds.data + cmds.pos, cmds.len - cmds.pos,
+                MSG_DONTWAIT | MSG_NOSIGNAL);
+
+            if (n == -1 && errno != EAGAIN && errno != EINTR)
+                lowm_err("[!] ERROR: lowm: Failed to send the data\n");
+
+            if (n > 0)
+                cmds.pos += n;
+
+            buffer_shift(&cmds);
+        }
+
+        if (input_done && !shut && cmds.pos == cmds.len) {
+            shutdown(sock_fd, SHUT_WR);
+            shut = true;
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            buffer_reserve(&replies, BUFSIZ);
+            ssize_t n = recv(sock_fd, replies.data + replies.len, replies.cap - replies.len, 0);
+
+            if (n <= 0)
+                break;
+
+            replies.len += n;
+            char *end;
+
+            while ((end = memchr(replies.data + replies.pos, '\0', replies.len - replies.pos)) != NULL) {
+                char *rsp = replies.data + replies.pos;
+
+                if (rsp[0] == FAILURE_MESSAGE[0]) {
+                    ret = EXIT_FAILURE;
+                    fprintf(stderr, "%s", rsp + 1);
+                } else {
+                    fprintf(stdout, "%s", rsp);
+                }
+
+                replies.pos += (end - rsp) + 1;
+                received++;
+            }
+
+            fflush(stdout);
+            buffer_shift(&replies);
+        }
+    }
+
+    if (received < sent) {
+        warn("[!] WARNING: lowm: %u commands didn't get a reply\n", sent - received);
+        ret = EXIT_FAILURE;
+    }
+
+    free(cmds.data);
+    free(lines.data);
+    free(replies.data);
+
+    return ret;
+}
+
 int
 main(int argc, char *argv[])
 {
     int sock_fd;
     struct sockadd_un sock_address;
-    char msg[BUFSIZ], rsp[BUFSIZ];
+    char rsp[BUFSIZ];
 
     if (argc < 2)
         lowm_err("[!] ERROR: lowm: No arguments given\n");
@@ -51,15 +269,47 @@ main(int argc, char *argv[])
 
     argc--;
     argv++;
-    int msg_len = 0, off;
 
-    for (off = 0; rem = sizeof(msg), n = 0; argc > 0 && rem > 0; off += n, rem -= n, argc--, argv++) {
-        n = snprintf(msg + off, rem, "%s%c", *argv, 0);
-        msg_len += n;
+    if (argc == 1 && streq("--batch", *argv)) {
+        int ret = run_batch(sock_fd);
+
+        close(sock_fd);
+
+        return ret;
     }
 
-    if (send(sock_fd, msg, msg_len, 0) == -1)
-        lowm_err("[!] ERROR: lowm: Failed to send the data\n");
+    size_t msg_len = 0;
+    int i;
+
+    for (i = 0; i < argc; i++)
+        msg_len += strlen(argv[i]) + 1;
+
+    char *msg = malloc(msg_len);
+
+    if (msg == NULL)
+        lowm_err("[!] ERROR: lowm: Failed to allocate the message\n");
+
+    size_t off = 0;
+
+    for (i = 0; i < argc; i++) {
+        size_t len = strlen(argv[i]) + 1;
+        memcpy(msg + off, argv[i], len);
+        off += len;
+    }
+
+    for (off = 0; off < msg_len; ) {
+        ssize_t n = send(sock_fd, msg + off, msg_len - off, 0);
+
+        if (n == -1)
+            lowm_err("[!] ERROR: lowm: Failed to send the data\n");
+
+        off += n;
+    }
+
+    free(msg);
+
+    /* Shutting down our writing end tells the server the message is complete. */
+    shutdown(sock_fd, SHUT_WR);
 
     int ret = EXIT_SUCCESS, nb;
 
@@ -10,6 +10,7 @@
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <sys/socket.h>
+#include <sys/signalfd.h>
 #include <sys/un.h>
 #include <signal.h>
 #include <unistd.h>
@@ -27,10 +28,17 @@
 #include "common.h"
 #include "window.h"
 #include "history.h"
+#include "ipc.h"
+#include "loop.h"
+#include "index.h"
 #include "ewmh.h"
 #include "rule.h"
 #include "restore.h"
 #include "query.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "subscribe.h"
+#include "tree.h"
 #include "lowm.h"
 
 xcb_connection_t *dpy;
@@ -58,17 +66,15 @@ bool restart, randr;
 int
 main(int argc, char *argv[])
 {
-    fd_set descriptors;
     char socket_path[MAXLEN];
     char state_path[MAXLEN] = { 0 };
     int run_level = 0;
 
     config_path[0] = '\0';
 
-    int sock_fd = -1, cli_fd, dpy_fd, max_fd, n;
+    int sock_fd = -1, dpy_fd, sig_fd;
     struct sockaddr_un sock_addr;
-    char msg[BUFSIZ];
-    xcb_generic_event_t *event;
+    sigset_t sig_mask;
     char *end;
     int opt;
 
@@ -119,6 +125,9 @@ main(int argc, char *argv[])
     if (!check_connection(dpy))
         exit(EXIT_FAILURE);
 
+    if (!loop_init())
+        lowm_err("[!] ERROR: lowm: Couldn't create the event loop\n");
+
     load_settings();
     setup();
 
@@ -130,19 +139,7 @@ main(int argc, char *argv[])
     dpy_fd = xcb_get_file_descriptor(dpy);
 
     if (sock_fd == -1) {
-        char *sp = getenv(SOCKET_ENV_VAR);
-
-        if (sp != NULL) {
-            snprintf(socket_path, sizeof(socket_path), "%s", sp);
-        } else {
-            char *host = NULL;
-            int dn = 0, sn = 0;
-
-            if (xcb_parse_display(NULL, &host, &dn, &sn) != 0)
-                snprintf(socket_path, sizeof(socket_path), SOCKET_PATH_TPL, host, dn, sn);
-
-            free(host);
-        }
+        runtime_path(socket_path, sizeof(socket_path), SOCKET_ENV_VAR, SOCKET_PATH_TPL);
 
         sock_addr.sun_family = AF_UNIX;
 
@@ -163,76 +160,65 @@ main(int argc, char *argv[])
             lowm_err("[!] ERROR: lowm: Coulnd't listen to the socket\n");
     }
 
-    signal(SIGINT, sig_handler);
-    signal(SIGHUP, sig_handler);
-    signal(SIGTERM, sig_handler);
-    signal(SIGCHLD, sig_handler);
-    signal(SIGPIPE, SIG_IGN);
-    run_config(run_level);
-    running = true;
+    char snapshot_path[MAXLEN] = { 0 };
+    char journal_path[MAXLEN] = { 0 };
 
-    while (running) {
-        xcb_flush(dpy);
+    runtime_path(snapshot_path, sizeof(snapshot_path), SNAPSHOT_ENV_VAR, SNAPSHOT_PATH_TPL);
+    runtime_path(journal_path, sizeof(journal_path), JOURNAL_ENV_VAR, JOURNAL_PATH_TPL);
 
-        FD_ZERO(&descriptors);
-        FD_SET(sock_fd, &descriptors);
-        FD_SET(dpy_fd, &descriptors);
-        max_fd = MAX(sock_fd, dpy_fd);
-        pending_rule_t *pr;
-
-        for (*pr = pending_rule_head; pr != NULL; pr = pr->next) {
-            FD_SET(pr->fd, &descriptors);
-
-            if (pr->fd > max_fd)
-                max_fd = pr->fd;
-        }
+    /* Readers can always fall back to the socket, the snapshot is a convenience. */
+    if (snapshot_path[0] != '\0' && !snapshot_open(snapshot_path))
+        warn("[!] WARNING: lowm: Couldn't publish the state snapshot at %s\n", snapshot_path);
 
-        if (select(max_fd + 1, &descriptors, NULL, NULL, NULL) > 0) {
-            pending_rule_t *pr = pending_rule_head;
+    /* Without a journal, subscribers just can't resume. */
+    if (journal_path[0] != '\0' && !journal_open(journal_path))
+        warn("[!] WARNING: lowm: Couldn't open the event journal at %s\n", journal_path);
 
-            while (pr != NULL) {
-                pending_rule_t *next = pr->next;
+    /* Signals are delivered through the event loop rather than interrupting it. */
+    sigemptyset(&sig_mask);
+    sigaddset(&sig_mask, SIGINT);
+    sigaddset(&sig_mask, SIGHUP);
+    sigaddset(&sig_mask, SIGTERM);
+    sigaddset(&sig_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &sig_mask, NULL);
+    signal(SIGPIPE, SIG_IGN);
 
-                if (FD_ISSET(pr->fd, &descriptors)) {
-                    if (manage_window(pr->win, pr->csq, pr->fd)) {
-                        for (event_queue_t *eq = pr->event_head; eq != NULL; eq = eq->next)
-                            handle_event(&eq->event);
-                    }
+    if ((sig_fd = signalfd(-1, &sig_mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1)
+        lowm_err("[!] ERROR: lowm: Couldn't create the signal descriptor\n");
 
-                    remove_pending_rule(pr);
-                }
+    loop_add(sig_fd, EPOLLIN, handle_signal, NULL);
+    loop_add(dpy_fd, EPOLLIN, handle_display, NULL);
+    if (!ipc_listen(sock_fd))
+        lowm_err("[!] ERROR: lowm: Couldn't listen for client connections\n");
 
-                pr = next;
-            }
+    run_config(run_level);
+    running = true;
 
-            if (FD_ISSET(sock_fd, &descriptors)) {
-                cli_fd = accept(sock_fd, NULL, 0);
+    while (running) {
+        /**
+         * Replies fetched by the previous handlers may have pulled events
+         * into XCB's queue without leaving anything to read on the socket.
+        **/
+        handle_display(NULL, 0);
+        arrange_dirty();
+        flush_report();
+        xcb_flush(dpy);
+        int timeout = ipc_timeout();
+        int delay = subscribe_timeout();
 
-                if (cli_fd > 0 && (n = recv(cli_fd, msg, sizeof(msg) - 1, 0)) > 0) {
-                    msg[n] = '\0';
-                    FILE *rsp = fdopen(cli_fd, "w");
+        if (delay != -1 && (timeout == -1 || delay < timeout))
+            timeout = delay;
 
-                    if (rsp != NULL) {
-                        handle_message(msg, n, rsp);
-                    } else {
-                        warn("[!] WARNING: lowm: Can't open client socket as file\n");
-                        close(cli_fd);
-                    }
-                }
-            }
+        if ((delay = rule_timeout()) != -1 && (timeout == -1 || delay < timeout))
+            timeout = delay;
 
-            if (FD_ISSET(dpy_fd, &descriptors)) {
-                while ((event = xcb_pool_for_event(dpy)) != NULL) {
-                    handle_event(event);
-                    free(event);
-                }
-            }
-        }
+        loop_wait(timeout);
+        ipc_expire();
+        subscribe_expire();
+        rule_expire();
 
         if (!check_connection(dpy))
             running = false;
-
-        prune_dead_subscribers();
     }
 
     if (restart) {
@@ -244,11 +230,17 @@ main(int argc, char *argv[])
 
         free(host);
         FILE *f = fopen(state_path, "w");
+        arrange_dirty();
         query_state(f);
         fclose(f);
     }
 
     cleanup();
+    snapshot_close();
+    journal_close();
+    ipc_close_all();
+    loop_close();
+    close(sig_fd);
     ungrab_buttons();
 
     xcb_ewmh_connection_wipe(ewmh);
@@ -293,6 +285,28 @@ main(int argc, char *argv[])
     return exit_status;
 }
 
+/**
+ * The path given by the environment variable, or the template filled in
+ * with the display we're running on.
+**/
+void
+runtime_path(char *dst, size_t size, char *env_var, char *tpl)
+{
+    char *path = getenv(env_var);
+
+    if (path != NULL) {
+        snprintf(dst, size, "%s", path);
+    } else {
+        char *host = NULL;
+        int dn = 0, sn = 0;
+
+        if (xcb_parse_display(NULL, &host, &dn, &sn) != 0)
+            snprintf(dst, size, tpl, host, dn, sn);
+
+        free(host);
+    }
+}
+
 void
 init(void)
 {
@@ -474,6 +488,7 @@ cleanup(void)
         remove_pending_rule(pending_rule_head);
 
     empty_history();
+    index_clear();
 }
 
 bool
@@ -525,18 +540,49 @@ check_connection(xcb_connection_t *dpy)
 }
 
 void
-sig_handler(int sig)
+handle_signal(event_source_t *src, uint32_t events)
+{
+    struct signalfd_siginfo info;
+
+    while (read(src->fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGCHLD) {
+            while (waitpid(-1, 0, WNOHANG) > 0)
+                ;
+        } else if (info.ssi_signo == SIGINT || info.ssi_signo == SIGHUP ||
+            info.ssi_signo == SIGTERM) {
+                running = false;
+        }
+    }
+}
+
+void
+handle_display(event_source_t *src, uint32_t events)
 {
-    if (sig == SIGCHLD) {
-        signal(sig, sig_handler);
+    xcb_generic_event_t *event;
 
-        while (waitpid(-1, 0, WNOHANG) > 0)
-            ;
-    } else if (sig == SIGINT || sig == SIGHUP || sig == SIGTERM) {
-        running = false;
+    if (src != NULL) {
+        while ((event = xcb_poll_for_event(dpy)) != NULL) {
+            handle_event(event);
+            free(event);
+        }
+    } else {
+        while ((event = xcb_poll_for_queued_event(dpy)) != NULL) {
+            handle_event(event);
+            free(event);
+        }
     }
 }
 
+void
+restore_signals(void)
+{
+    sigset_t sig_mask;
+
+    sigemptyset(&sig_mask);
+    sigprocmask(SIG_SETMASK, &sig_mask, NULL);
+    signal(SIGPIPE, SIG_DFL);
+}
+
 /* Adopted from i3wm */
 uint32_t
 get_color_pixel(const char *color)
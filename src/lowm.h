@@ -80,7 +80,10 @@ void setup(void);
 void register_events(void);
 void cleanup(void);
 bool check_connection(xcb_connection_t *dpy);
-void sig_handler(int sig);
+void handle_signal(event_source_t *src, uint32_t events);
+void handle_display(event_source_t *src, uint32_t events);
+void restore_signals(void);
+void runtime_path(char *dst, size_t size, char *env_var, char *tpl);
 uint32_t get_color_pixel(const char *color);
 
 #endif
@@ -9,10 +9,15 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include <inttypes.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include "lowm.h"
+#include "batch.h"
+#include "delta.h"
 #include "desktop.h"
+#include "ipc.h"
+#include "journal.h"
 #include "monitor.h"
 #include "pointer.h"
 #include "query.h"
@@ -75,6 +80,10 @@ handle_message(char *msg, int msg_len, FILE *rsp)
 void
 process_message(char **args, int num, FILE *rsp)
 {
+    /* Queries report the geometry the windows are about to get. */
+    if (streq("query", *args))
+        arrange_dirty();
+
     if (streq("node", *args))
         cmd_node(++args, --num, rsp);
     else if (streq("desktop", *args))
@@ -86,16 +95,45 @@ process_message(char **args, int num, FILE *rsp)
     else if (streq("subscribe", *args))
         cmd_subscribe(++args, --num, rsp);
     else if (streq("wm", *args))
-        cmd_rule(++args, --num, rsp);
+        cmd_wm(++args, --num, rsp);
     else if (streq("rule", *args))
-        cmd_config(++args, --num, rsp);
+        cmd_rule(++args, --num, rsp);
     else if (streq("config", *args))
-        cmd_quit(++args, --num, rsp);
+        cmd_config(++args, --num, rsp);
+    else if (streq("begin", *args))
+        cmd_begin(++args, --num, rsp);
+    else if (streq("commit", *args))
+        cmd_commit(++args, --num, rsp);
     else
         fail(rsp, "[!] ERROR: lowm: Unknown domain or command: '%s'\n", *args);
 
     fflush(rsp);
-    fclose(rsp);
+}
+
+void
+cmd_begin(char **args, int num, FILE *rsp)
+{
+    if (num > 0) {
+        fail(rsp, "[!] ERROR: lowm: begin: Unknown argument: '%s'\n", *args);
+
+        return;
+    }
+
+    if (!batch_begin())
+        fail(rsp, "[!] ERROR: lowm: begin: Not available outside a connection\n");
+}
+
+void
+cmd_commit(char **args, int num, FILE *rsp)
+{
+    if (num > 0) {
+        fail(rsp, "[!] ERROR: lowm: commit: Unknown argument: '%s'\n", *args);
+
+        return;
+    }
+
+    if (!batch_commit())
+        fail(rsp, "[!] ERROR: lowm: commit: No batch in progress\n");
 }
 
 void
@@ -717,3 +755,424 @@ cmd_desktop(char **args, int num, FILE *rsp) {
     coordinates_t ref = { mon, mon->desk, NULL };
     coordinates_t trg = ref;
 }
+
+/* Where the id given to a scope option goes: monitor, desktop or node. */
+static int
+scope_option(char *arg)
+{
+    if (streq("-m", arg) || streq("--monitor", arg))
+        return 0;
+    else if (streq("-d", arg) || streq("--desktop", arg))
+        return 1;
+    else if (streq("-n", arg) || streq("--node", arg))
+        return 2;
+
+    return -1;
+}
+
+void
+cmd_query(char **args, int num, FILE *rsp)
+{
+    coordinates_t ref = { mon, mon->desk, mon->desk->focus };
+    coordinates_t trg = { NULL, NULL, NULL };
+    char dom = 0;
+    int level = -1;
+    bool names = false, delta = false, projected = false;
+    uint64_t since = 0;
+    projection_t fields;
+    int i, ret;
+
+    while (num > 0) {
+        if (streq("-T", *args) || streq("--tree", *args)) {
+            dom = 'T';
+        } else if (streq("-M", *args) || streq("--monitors", *args)) {
+            dom = 'M';
+        } else if (streq("-D", *args) || streq("--desktops", *args)) {
+            dom = 'D';
+        } else if (streq("-N", *args) || streq("--nodes", *args)) {
+            dom = 'N';
+        } else if (streq("--names", *args)) {
+            names = true;
+        } else if (streq("--since", *args)) {
+            num--, args++;
+
+            if (num < 1) {
+                fail(rsp, "[!] ERROR: lowm: query %s: Not enough arguments\n", *(args - 1));
+
+                return;
+            }
+
+            if (sscanf(*args, "%" SCNu64, &since) != 1) {
+                fail(rsp, "[!] ERROR: lowm: query %s: Invalid argument: '%s'\n", *(args - 1),
+                    *args);
+
+                return;
+            }
+
+            delta = true;
+        } else if (streq("--fields", *args)) {
+            num--, args++;
+
+            if (num < 1) {
+                fail(rsp, "[!] ERROR: lowm: query %s: Not enough arguments\n", *(args - 1));
+
+                return;
+            }
+
+            if (!parse_projection(*args, &fields)) {
+                fail(rsp, "[!] ERROR: lowm: query %s: Invalid argument: '%s'\n", *(args - 1),
+                    *args);
+
+                return;
+            }
+
+            projected = true;
+        } else if ((i = scope_option(*args)) != -1) {
+            coordinates_t dst = ref;
+
+            if (num > 1 && *(args + 1)[0] != OPT_CHR) {
+                num--, args++;
+
+                if (i == 0)
+                    ret = monitor_from_desc(*args, &ref, &dst);
+                else if (i == 1)
+                    ret = desktop_from_desc(*args, &ref, &dst);
+                else
+                    ret = node_from_desc(*args, &ref, &dst);
+
+                if (ret != SELECTOR_OK) {
+                    handle_failure(ret, "query", *args, rsp);
+
+                    return;
+                }
+            }
+
+            trg.monitor = dst.monitor;
+            trg.desktop = (i >= 1 ? dst.desktop : trg.desktop);
+            trg.node = (i == 2 ? dst.node : trg.node);
+            level = (i > level ? i : level);
+        } else {
+            fail(rsp, "[!] ERROR: lowm: query: Unknown option: '%s'\n", *args);
+
+            return;
+        }
+
+        num--, args++;
+    }
+
+    if (dom == 0) {
+        fail(rsp, "[!] ERROR: lowm: query: No commands given\n");
+
+        return;
+    }
+
+    if (delta && (dom != 'T' || level != -1)) {
+        fail(rsp, "[!] ERROR: lowm: query --since: Only applies to the whole tree\n");
+
+        return;
+    }
+
+    if (dom == 'T') {
+        query_projection(projected ? &fields : NULL);
+
+        if (delta && !delta_covers(since))
+            fail(rsp, "[!] ERROR: lowm: query --since: Generation %" PRIu64 " is too old, "
+                "query the whole tree\n", since);
+        else if (delta)
+            query_state_since(since, rsp);
+        else if (level == -1)
+            query_state(rsp);
+        else if (level == 0)
+            query_monitor(trg.monitor, rsp);
+        else if (level == 1)
+            query_desktop(trg.desktop, rsp);
+        else if (trg.node != NULL)
+            query_node(trg.node, rsp);
+        else
+            fail(rsp, "");
+
+        query_projection(NULL);
+
+        return;
+    }
+
+    int count;
+
+    if (dom == 'M')
+        count = query_monitor_ids(&ref, &trg, NULL, names ? fprintf_monitor_name :
+            fprintf_monitor_id, rsp);
+    else if (dom == 'D')
+        count = query_desktop_ids(&ref, &ref, &trg, NULL, NULL, names ? fprintf_desktop_name :
+            fprintf_desktop_id, rsp);
+    else
+        count = query_node_ids(&ref, &ref, &ref, &trg, NULL, NULL, NULL, rsp);
+
+    if (count == 0)
+        fail(rsp, "");
+}
+
+void
+cmd_subscribe(char **args, int num, FILE *rsp)
+{
+    int field = 0;
+    int count = -1;
+    subscriber_policy_t policy = SBSC_POLICY_DROP_OLDEST;
+    uint32_t scope[] = { 0, 0, 0 };
+    throttle_rule_t *rules = NULL;
+    char *fifo_path = NULL;
+    bool seq = false, resume = false;
+    uint64_t resume_from = 0;
+    subscriber_mask_t mask;
+    int fd, i;
+
+    while (num > 0) {
+        if (streq("-c", *args) || streq("--count", *args)) {
+            num--, args++;
+
+            if (num < 1) {
+                fail(rsp, "[!] ERROR: lowm: subscribe %s: Not enough arguments\n", *(args - 1));
+                goto cleanup;
+            }
+
+            if (sscanf(*args, "%i", &count) != 1 || count < 1) {
+                fail(rsp, "[!] ERROR: lowm: subscribe %s: Invalid argument: '%s'\n",
+                    *(args - 1), *args);
+                goto cleanup;
+            }
+        } else if (streq("-p", *args) || streq("--policy", *args)) {
+            num--, args++;
+
+            if (num < 1) {
+                fail(rsp, "[!] ERROR: lowm: subscribe %s: Not enough arguments\n", *(args - 1));
+                goto cleanup;
+            }
+
+            if (!parse_subscriber_policy(*args, &policy)) {
+                fail(rsp, "[!] ERROR: lowm: subscribe %s: Invalid argument: '%s'\n",
+                    *(args - 1), *args);
+                goto cleanup;
+            }
+        } else if ((i = scope_option(*args)) != -1) {
+            num--, args++;
+
+            if (num < 1) {
+                fail(rsp, "[!] ERROR: lowm: subscribe %s: Not enough arguments\n", *(args - 1));
+                goto cleanup;
+            }
+
+            if (!parse_id(*args, &scope[i]) || scope[i] == 0) {
+                fail(rsp, "[!] ERROR: lowm: subscribe %s: Invalid argument: '%s'\n",
+                    *(args - 1), *args);
+                goto cleanup;
+            }
+        } else if (streq("-t", *args) || streq("--throttle", *args)) {
+            num--, args++;
+
+            if (num < 1) {
+                fail(rsp, "[!] ERROR: lowm: subscribe %s: Not enough arguments\n", *(args - 1));
+                goto cleanup;
+            }
+
+            /* EVENT:MILLISECONDS */
+            char *colon = strrchr(*args, ':');
+            unsigned int interval;
+            throttle_rule_t *tr;
+
+            if (colon == NULL || sscanf(colon + 1, "%u", &interval) != 1 || interval == 0) {
+                fail(rsp, "[!] ERROR: lowm: subscribe %s: Invalid argument: '%s'\n",
+                    *(args - 1), *args);
+                goto cleanup;
+            }
+
+            *colon = '\0';
+
+            if (!parse_subscriber_mask(*args, &mask) || mask == SBSC_MASK_REPORT) {
+                *colon = ':';
+                fail(rsp, "[!] ERROR: lowm: subscribe %s: Invalid argument: '%s'\n",
+                    *(args - 1), *args);
+                goto cleanup;
+            }
+
+            if ((tr = make_throttle_rule(mask, interval)) == NULL)
+                goto cleanup;
+
+            tr->next = rules;
+            rules = tr;
+        } else if (streq("-s", *args) || streq("--seq", *args)) {
+            seq = true;
+        } else if (streq("-r", *args) || streq("--resume", *args)) {
+            num--, args++;
+
+            if (num < 1) {
+                fail(rsp, "[!] ERROR: lowm: subscribe %s: Not enough arguments\n", *(args - 1));
+                goto cleanup;
+            }
+
+            if (sscanf(*args, "%" SCNu64, &resume_from) != 1) {
+                fail(rsp, "[!] ERROR: lowm: subscribe %s: Invalid argument: '%s'\n",
+                    *(args - 1), *args);
+                goto cleanup;
+            }
+
+            resume = seq = true;
+        } else if (streq("-f", *args) || streq("--fifo", *args)) {
+            if (fifo_path == NULL && (fifo_path = mktempfifo(FIFO_TEMPLATE)) == NULL) {
+                fail(rsp, "[!] ERROR: lowm: subscribe %s: Can't create FIFO\n", *args);
+                goto cleanup;
+            }
+        } else if (parse_subscriber_mask(*args, &mask)) {
+            field |= mask;
+        } else {
+            fail(rsp, "[!] ERROR: lowm: subscribe: Invalid argument: '%s'\n", *args);
+            goto cleanup;
+        }
+
+        num--, args++;
+    }
+
+    if (field == 0)
+        field = SBSC_MASK_REPORT;
+
+    /* Better to say so now than to silently skip what was lost. */
+    if (resume && !journal_covers(resume_from)) {
+        fail(rsp, "[!] ERROR: lowm: subscribe: The events following %" PRIu64 " are no longer "
+            "available\n", resume_from);
+        goto cleanup;
+    }
+
+    if (fifo_path != NULL) {
+        /**
+         * Opening the writing end alone would block until someone opens the
+         * FIFO for reading, which can't happen before we print its path.
+         * The subscriber trades it for a writing end once a reader took
+         * some of what it wrote.
+        **/
+        if ((fd = open(fifo_path, O_RDWR | O_NONBLOCK)) == -1) {
+            fail(rsp, "[!] ERROR: lowm: subscribe: Can't open FIFO\n");
+            goto cleanup;
+        }
+
+        fprintf(rsp, "%s\n", fifo_path);
+    } else if ((fd = ipc_detach()) == -1) {
+        fail(rsp, "[!] ERROR: lowm: subscribe: Not available in a session, use --fifo\n");
+        goto cleanup;
+    }
+
+    subscriber_list_t *sb = make_subscriber(fd, fifo_path, field, count, policy);
+
+    if (sb == NULL) {
+        close(fd);
+        goto cleanup;
+    }
+
+    sb->monitor_id = scope[0];
+    sb->desktop_id = scope[1];
+    sb->node_id = scope[2];
+    sb->seq = seq;
+    sb->resume = resume;
+    sb->resume_from = resume_from;
+    sb->throttle_rules = rules;
+    add_subscriber(sb);
+
+    return;
+
+cleanup:
+    while (rules != NULL) {
+        throttle_rule_t *next = rules->next;
+        free(rules);
+        rules = next;
+    }
+
+    if (fifo_path != NULL) {
+        unlink(fifo_path);
+        free(fifo_path);
+    }
+}
+
+void
+cmd_config(char **args, int num, FILE *rsp)
+{
+    coordinates_t loc = { mon, mon->desk, mon->desk->focus };
+
+    if (num == 2)
+        set_setting(loc, *args, *(args + 1), rsp);
+    else if (num == 1)
+        get_setting(loc, *args, rsp);
+    else
+        fail(rsp, "[!] ERROR: lowm: config: Was expecting 1 or 2 arguments, received %i\n", num);
+}
+
+/* The settings the layout keys don't cover: changing one lays everything out again. */
+static struct {
+    char *name;
+    bool *value;
+} layout_settings[] = {
+    { "borderless_monocle", &borderless_monocle },
+    { "borderless_singleton", &borderless_singleton },
+    { "gapless_monocle", &gapless_monocle },
+    { "center_pseudo_tiled", &center_pseudo_tiled },
+    { "honor_size_hints", &honor_size_hints },
+};
+
+static bool *
+layout_setting(char *name)
+{
+    for (unsigned int i = 0; i < LENGTH(layout_settings); i++) {
+        if (streq(layout_settings[i].name, name))
+            return layout_settings[i].value;
+    }
+
+    return NULL;
+}
+
+void
+set_setting(coordinates_t loc, char *name, char *value, FILE *rsp)
+{
+    bool b, *setting;
+
+    if ((setting = layout_setting(name)) != NULL) {
+        if (!parse_bool(value, &b)) {
+            fail(rsp, "[!] ERROR: lowm: config: %s: Invalid value: '%s'\n", name, value);
+
+            return;
+        }
+
+        if (b != *setting) {
+            *setting = b;
+            invalidate_all_layouts();
+        }
+    } else if (streq("external_rules_command", name)) {
+        snprintf(external_rules_command, sizeof(external_rules_command), "%s", value);
+
+        /* A daemon running the previous command has no say anymore. */
+        stop_rules_daemon();
+    } else if (streq("external_rules_daemon", name)) {
+        if (!parse_bool(value, &b)) {
+            fail(rsp, "[!] ERROR: lowm: config: %s: Invalid value: '%s'\n", name, value);
+
+            return;
+        }
+
+        if (!b)
+            stop_rules_daemon();
+
+        external_rules_daemon = b;
+    } else {
+        fail(rsp, "[!] ERROR: lowm: config: Unknown setting: '%s'\n", name);
+    }
+}
+
+void
+get_setting(coordinates_t loc, char *name, FILE *rsp)
+{
+    bool *setting;
+
+    if ((setting = layout_setting(name)) != NULL)
+        fprintf(rsp, "%s\n", BOOL_STR(*setting));
+    else if (streq("external_rules_command", name))
+        fprintf(rsp, "%s\n", external_rules_command);
+    else if (streq("external_rules_daemon", name))
+        fprintf(rsp, "%s\n", BOOL_STR(external_rules_daemon));
+    else
+        fail(rsp, "[!] ERROR: lowm: config: Unknown setting: '%s'\n", name);
+}
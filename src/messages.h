@@ -14,6 +14,8 @@
 
 void handle_message(char *msg, int msg_len, FILE *rsp);
 void process_message(char **args, int num, FILE *rsp);
+void cmd_begin(char **args, int num, FILE *rsp);
+void cmd_commit(char **args, int num, FILE *rsp);
 void cmd_node(char **args, int num, FILE *rsp);
 void cmd_desktop(char **args, int num, FILE *rsp);
 void cmd_monitor(char **args, int num, FILE *rsp);
@@ -10,6 +10,7 @@
 #include <stdbool.h>
 
 #include "lowm.h"
+#include "delta.h"
 #include "desktop.h"
 #include "ewmh.h"
 #include "query.h"
@@ -40,6 +41,7 @@ make_monitor(const char *name, xcb_rectangle_t *rect, uint32_t id)
     m->desk = m->desk_head = m->desk_tail = NULL;
     m->wired = true;
     m->sticky_count = 0;
+    m->generation = next_generation();
 
     if (rect != NULL)
         update_root(m, rect);
@@ -271,6 +273,7 @@ remove_monitor(monitor_t *m)
     monitor_t *last_mon = mon;
     unlink_monitor(m);
     xcb_destroy_window(dpy, m->root);
+    bury(TOMBSTONE_MONITOR, m->id);
     free(m);
 
     if (mon != last_mon)
@@ -301,6 +304,8 @@ swap_monitors(monitor_t *m1, monitor_t *m2)
         return false;
 
     put_status(SBSC_MASK_MONITOR_SWAP, "monitor_swap 0x%08X 0x%08X\n", m1->id, m2->id);
+    touch_monitor(m1);
+    touch_monitor(m2);
 
     if (mon_head == m1)
         mon_head = m2;
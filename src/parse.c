@@ -533,6 +533,26 @@ parse_rectangle(char *s, xcb_rectangle_t *r)
     return true;
 }
 
+bool
+parse_subscriber_policy(char *s, subscriber_policy_t *p)
+{
+    if (streq("drop_oldest", s)) {
+        *p = SBSC_POLICY_DROP_OLDEST;
+
+        return true;
+    } else if (streq("coalesce", s)) {
+        *p = SBSC_POLICY_COALESCE;
+
+        return true;
+    } else if (streq("disconnect", s)) {
+        *p = SBSC_POLICY_DISCONNECT;
+
+        return true;
+    }
+
+    return false;
+}
+
 bool
 parse_subscriber_mask(char *s, subscriber_mask_t *mask)
 {
@@ -606,6 +626,107 @@ parse_subscriber_mask(char *s, subscriber_mask_t *mask)
     return true;
 }
 
+/* In the order of the bits of monitor_field_t, desktop_field_t, node_field_t and client_field_t. */
+static const char *monitor_fields[] = { "name", "id", "randrId", "wired", "stickyCount",
+    "windowGap", "borderWidth", "focusedDesktopId", "padding", "rectangle", NULL };
+static const char *desktop_fields[] = { "name", "id", "layout", "userLayout", "windowGap",
+    "borderWidth", "focusedNodeId", "padding", NULL };
+static const char *node_fields[] = { "id", "splitType", "splitRatio", "vacant", "hidden",
+    "sticky", "private", "locked", "marked", "presel", "rectangle", "constraints", "client", NULL };
+static const char *client_fields[] = { "className", "instanceName", "borderWidth", "state",
+    "lastState", "layer", "lastLayer", "urgent", "shown", "tiledRectangle", "floatingRectangle",
+    NULL };
+
+static bool
+parse_field(const char **names, char *s, uint32_t *mask)
+{
+    for (int i = 0; names[i] != NULL; i++) {
+        if (streq(names[i], s)) {
+            *mask |= 1 << i;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * A comma separated list of fields, prefixed by `monitor.`, `desktop.` or
+ * `client.`, or by nothing for the fields of nodes.
+**/
+bool
+parse_projection(char *s, projection_t *p)
+{
+    char *tok, *save = NULL;
+    char *x = copy_string(s, strlen(s));
+
+    *p = (projection_t) { 0, 0, 0, 0 };
+
+    for (tok = strtok_r(x, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        bool ok;
+
+        if (strncmp(tok, "monitor.", 8) == 0)
+            ok = parse_field(monitor_fields, tok + 8, &p->monitor);
+        else if (strncmp(tok, "desktop.", 8) == 0)
+            ok = parse_field(desktop_fields, tok + 8, &p->desktop);
+        else if (strncmp(tok, "client.", 7) == 0)
+            ok = parse_field(client_fields, tok + 7, &p->client);
+        else if (strncmp(tok, "node.", 5) == 0)
+            ok = parse_field(node_fields, tok + 5, &p->node);
+        else
+            ok = parse_field(node_fields, tok, &p->node);
+
+        if (!ok) {
+            free(x);
+
+            return false;
+        }
+    }
+
+    free(x);
+
+    /* Asking for some fields of the clients implies asking for the clients. */
+    if (p->node != 0 && p->client != 0)
+        p->node |= NODE_FIELD_CLIENT;
+
+    return true;
+}
+
+#define NODE_MASK(k, f)                                                              \
+    if (sel->k == OPTION_TRUE)                                                       \
+        sel->required |= f;                                                          \
+    else if (sel->k == OPTION_FALSE)                                                 \
+        sel->forbidden |= f;
+
+/* Turn the modifiers that only concern the node itself into a pair of masks. */
+static void
+compile_node_masks(node_select_t *sel)
+{
+    sel->required = sel->forbidden = 0;
+
+    NODE_MASK(automatic, NODE_FLAG_AUTOMATIC)
+    NODE_MASK(window, NODE_FLAG_WINDOW)
+    NODE_MASK(hidden, NODE_FLAG_HIDDEN)
+    NODE_MASK(sticky, NODE_FLAG_STICKY)
+    NODE_MASK(private, NODE_FLAG_PRIVATE)
+    NODE_MASK(locked, NODE_FLAG_LOCKED)
+    NODE_MASK(marked, NODE_FLAG_MARKED)
+    NODE_MASK(tiled, NODE_FLAG_TILED)
+    NODE_MASK(pseudo_tiled, NODE_FLAG_PSEUDO_TILED)
+    NODE_MASK(floating, NODE_FLAG_FLOATING)
+    NODE_MASK(fullscreen, NODE_FLAG_FULLSCREEN)
+    NODE_MASK(below, NODE_FLAG_BELOW)
+    NODE_MASK(normal, NODE_FLAG_NORMAL)
+    NODE_MASK(above, NODE_FLAG_ABOVE)
+    NODE_MASK(urgent, NODE_FLAG_URGENT)
+    NODE_MASK(leaf, NODE_FLAG_LEAF)
+    NODE_MASK(horizontal, NODE_FLAG_HORIZONTAL)
+    NODE_MASK(vertical, NODE_FLAG_VERTICAL)
+}
+
+#undef NODE_MASK
+
 #define GET_MOD(k)                                                                   \
     else if (streq(#k, tok))                                                         \
         sel->k = OPTION_TRUE;                                                        \
@@ -703,6 +824,8 @@ parse_node_modifiers(char *desc, node_select_t *sel)
         }
     }
 
+    compile_node_masks(sel);
+
     return true;
 }
 
@@ -40,7 +40,9 @@ bool parse_degree(char *s, int *d);
 bool parse_id(char *s, uint32_t *id);
 bool parse_bool_declaration(char *s, char **key, bool *value, alter_state_t *state);
 bool parse_index(char *s, uint16_t *idx);
+bool parse_subscriber_policy(char *s, subscriber_policy_t *p);
 bool parse_subscriber_mask(char *s, subscriber_mask_t *mask);
+bool parse_projection(char *s, projection_t *p);
 bool parse_monitor_modifiers(char *desc, monitor_select_t *sel);
 bool parse_desktop_modifiers(char *desc, desltop_select_t *sel);
 bool parse_node_modifiers(char *desc, node_select_t *sel);
@@ -0,0 +1,61 @@
+/**
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/pool.c }
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * See the file LICENSE for details.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "lowm.h"
+#include "pool.h"
+
+/* Objects start right after the slab header, aligned like any of them would be. */
+static bool
+pool_grow(pool_t *p)
+{
+    size_t header = POOL_ROUND(sizeof(pool_slab_t));
+    char *slab = calloc(1, header + p->size * p->count);
+
+    if (slab == NULL) {
+        perror("pool: calloc");
+
+        return false;
+    }
+
+    ((pool_slab_t *) slab)->next = p->slabs;
+    p->slabs = (pool_slab_t *) slab;
+
+    for (size_t i = p->count; i > 0; i--) {
+        void **obj = (void **) (slab + header + (i - 1) * p->size);
+        *obj = p->free_list;
+        p->free_list = obj;
+    }
+
+    return true;
+}
+
+void *
+pool_alloc(pool_t *p)
+{
+    if (p->free_list == NULL && !pool_grow(p))
+        return NULL;
+
+    void **obj = p->free_list;
+    p->free_list = *obj;
+    memset(obj, 0, p->size);
+
+    return obj;
+}
+
+void
+pool_free(pool_t *p, void *obj)
+{
+    if (obj == NULL)
+        return;
+
+    *(void **) obj = p->free_list;
+    p->free_list = obj;
+}
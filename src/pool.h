@@ -0,0 +1,38 @@
+/**
+ * LOWM: An advanced tiling window manager for Unix.
+ *
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/pool.h }.
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * Refer to the file LICENSE for additional details.
+**/
+
+#ifndef LOWM_POOL_H
+#define LOWM_POOL_H
+
+#define POOL_SLAB_COUNT 64
+#define POOL_ALIGN 16
+#define POOL_ROUND(n) (((n) + POOL_ALIGN - 1) & ~((size_t) POOL_ALIGN - 1))
+#define POOL_INIT(type) { POOL_ROUND(sizeof(type)), POOL_SLAB_COUNT, NULL, NULL }
+
+typedef struct pool_slab_t pool_slab_t;
+
+struct pool_slab_t {
+    pool_slab_t *next;
+};
+
+typedef struct {
+    size_t size;
+    size_t count;
+    void *free_list;
+    pool_slab_t *slabs;
+} pool_t;
+
+/**
+ * Objects of one type, carved out of slabs of POOL_SLAB_COUNT of them,
+ * and kept on a free list once released. They come out zeroed, like
+ * they would from calloc, and their slabs are never given back.
+**/
+void *pool_alloc(pool_t *p);
+void pool_free(pool_t *p, void *obj);
+
+#endif
@@ -14,6 +14,7 @@
 #include "desktop.h"
 #include "ewmh.h"
 #include "history.h"
+#include "index.h"
 #include "pointer.h"
 #include "monitor.h"
 #include "query.h"
@@ -24,6 +25,7 @@
 #include "restore.h"
 #include "window.h"
 #include "parse.h"
+#include "intern.h"
 
 bool
 restore_state(const char *fpath)
@@ -174,6 +176,8 @@ restore_state(const char *fpath)
             pri_mon = loc.monitor;
     }
 
+    index_rebuild();
+
     if (focus_history_token != NULL)
         restore_history(&focus_history_token, json);
 
@@ -199,7 +203,7 @@ restore_state(const char *fpath)
                 if (n->client == NULL)
                     continue;
 
-                initialize_client(n);
+                initialize_client(n, NULL);
                 uint32_t values[] = { CLIENT_EVENT_MASK | (focus_follows_pointer ?
                     XCB_EVENT_MASK_ENTER_WINDOW : 0) };
                 xcb_change_window_attributes(dpy, n->id, XCB_CW_EVENT_MASK, values);
@@ -435,6 +439,8 @@ restore_node(jsmntok_t **t, char *json)
             (*t)++;
         }
 
+        update_node_flags(n);
+
         return n;
     }
 }
@@ -467,6 +473,18 @@ restore_presel(jsmntok_t **t, char *json)
     }
 }
 
+/* Swap the name an id stands for with the string a token holds. */
+static void
+restore_name(uint32_t *id, jsmntok_t *t, char *json)
+{
+    char name[MAXLEN];
+    int n = t->end - t->start;
+
+    snprintf(name, sizeof(name), "%.*s", n, json + t->start);
+    intern_release(*id);
+    *id = intern(name);
+}
+
 client_t *
 restore_client(jsmntok_t **t, char *json)
 {
@@ -483,11 +501,10 @@ restore_client(jsmntok_t **t, char *json)
         for (i = 0; i < s; i++) {
             if (keyeq("className", *t, json)) {
                 (*t)++;
-                snprintf(c->class_name, (*t)->end - (*t)->start + 1, "%s", json + (*t)->start);
+                restore_name(&c->class_id, *t, json);
             } else if (keyeq("instanceName", *t, json)) {
                 (*t)++;
-                snprintf(c->instance_name, (*t)->end - (*t)->start + 1, "%s", json +
-                    (*t)->start);
+                restore_name(&c->instance_id, *t, json);
 
             RESTORE_ANY(state, &c->state, parse_client_state)
             RESTORE_ANY(lastState, *c->last_state, parse_client_state)
@@ -629,7 +646,7 @@ restore_stack(jsmntok_t **t, char *json)
         coordinates_t loc;
 
         if (locate_window(id, &loc))
-            stack_insert_after(stack_tail, loc.node);
+            stack_insert(loc.node, true);
 
         (*t)++;
     }
@@ -7,33 +7,141 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
 
 #include "lowm.h"
 #include "ewmh.h"
+#include "events.h"
+#include "loop.h"
 #include "window.h"
 #include "query.h"
 #include "parse.h"
 #include "settings.h"
+#include "intern.h"
 #include "rule.h"
 
+/**
+ * Rules are also filed by the ids of their exact class and instance
+ * names, either of which may be MATCH_ANY, so that a window only has to
+ * look at four buckets. Within a bucket, rules keep the order in which
+ * they were added, and their sequence numbers tell how to merge the
+ * buckets.
+**/
+typedef struct rule_bucket_t rule_bucket_t;
+
+struct rule_bucket_t {
+    uint32_t class_id;
+    uint32_t instance_id;
+    uint32_t hash;
+    rule_t *head;
+    rule_t *tail;
+    rule_bucket_t *next;
+};
+
+static rule_bucket_t *rule_buckets[RULE_BUCKETS];
+static uint64_t rule_seq = 0;
+
+static uint32_t
+rule_hash(uint32_t class_id, uint32_t instance_id)
+{
+    return (class_id * 2654435761u) ^ instance_id;
+}
+
+static rule_bucket_t *
+find_rule_bucket(uint32_t class_id, uint32_t instance_id, bool create)
+{
+    uint32_t h = rule_hash(class_id, instance_id);
+    rule_bucket_t **slot = &rule_buckets[h % RULE_BUCKETS];
+
+    for (rule_bucket_t *b = *slot; b != NULL; b = b->next) {
+        if (b->class_id == class_id && b->instance_id == instance_id)
+            return b;
+    }
+
+    if (!create)
+        return NULL;
+
+    rule_bucket_t *b = calloc(1, sizeof(rule_bucket_t));
+
+    if (b == NULL) {
+        perror("rule: calloc");
+
+        return NULL;
+    }
+
+    b->class_id = class_id;
+    b->instance_id = instance_id;
+    b->hash = h;
+    b->next = *slot;
+    *slot = b;
+
+    return b;
+}
+
+static void
+unfile_rule(rule_t *r)
+{
+    rule_bucket_t *b = r->bucket;
+
+    if (b == NULL)
+        return;
+
+    if (r->bucket_prev != NULL)
+        r->bucket_prev->bucket_next = r->bucket_next;
+    else
+        b->head = r->bucket_next;
+
+    if (r->bucket_next != NULL)
+        r->bucket_next->bucket_prev = r->bucket_prev;
+    else
+        b->tail = r->bucket_prev;
+
+    r->bucket = NULL;
+
+    if (b->head != NULL)
+        return;
+
+    rule_bucket_t **slot = &rule_buckets[b->hash % RULE_BUCKETS];
+
+    while (*slot != b)
+        slot = &(*slot)->next;
+
+    *slot = b->next;
+    free(b);
+}
+
 rule_t *
 make_rule(void)
 {
     rule_t *r = calloc(1, sizeof(rule_t));
 
-    r->class_name[0] = r->instance_name[0] = r->name[0] = r->effect[0] = '\0';
+    r->class_id = r->instance_id = 0;
+    r->name[0] = r->effect[0] = '\0';
     r->next = r->prev = NULL;
+    r->bucket = NULL;
+    r->bucket_next = r->bucket_prev = NULL;
     r->one_shot = false;
 
     return r;
 }
 
+/* The effect is parsed here, once and for all. */
 void
 add_rule(rule_t *r)
 {
+    char effect[MAXLEN];
+
+    snprintf(effect, sizeof(effect), "%s", r->effect);
+    memset(&r->delta, 0, sizeof(r->delta));
+    compile_key_values(effect, &r->delta);
+    r->seq = ++rule_seq;
+
     if (rule_head == NULL) {
         rule_head = rule_tail = r;
     } else {
@@ -41,6 +149,25 @@ add_rule(rule_t *r)
         r->prev = rule_tail;
         rule_tail = r;
     }
+
+    /* Classless windows have id 0 too, a rule without names isn't for them. */
+    if (r->class_id == 0 || r->instance_id == 0)
+        return;
+
+    rule_bucket_t *b = find_rule_bucket(r->class_id, r->instance_id, true);
+
+    if (b == NULL)
+        return;
+
+    r->bucket = b;
+    r->bucket_prev = b->tail;
+
+    if (b->tail != NULL)
+        b->tail->bucket_next = r;
+    else
+        b->head = r;
+
+    b->tail = r;
 }
 
 void
@@ -49,6 +176,8 @@ remove_rule(rule_t *r)
     if (r == NULL)
         return;
 
+    unfile_rule(r);
+
     rule_t *prev = r->prev;
     rule_t *next = r->next;
 
@@ -64,6 +193,8 @@ remove_rule(rule_t *r)
     if (r == rule_tail)
         rule_tail = prev;
 
+    intern_release(r->class_id);
+    intern_release(r->instance_id);
     free(r);
 }
 
@@ -74,14 +205,17 @@ remove_rule_by_cause(char *cause)
     char *class_name = strtok(cause, COL_TOK);
     char *instance_name = strtok(NULL, COL_TOK);
     char *name = strtok(NULL, COL_TOK);
+    uint32_t class_id = intern_find(class_name);
+    uint32_t instance_id = intern_find(instance_name);
 
     while (r != NULL) {
         rule_t *next = r->next;
 
-        if ((class_name != NULL && (streq(class_name. MATCH_ANY) ||
-            streq(r->class_name, class_name))) && (instance_name == NULL ||
-            streq(instance_name, MATCH_ANY) || streq(r->instance_name, instance_name)) &&
-            (name == NULL || streq(name, MATCH_ANY) || streq(r->name, name)))
+        if ((class_name != NULL && (streq(class_name, MATCH_ANY) ||
+            (class_id != 0 && r->class_id == class_id))) && (instance_name == NULL ||
+            streq(instance_name, MATCH_ANY) || (instance_id != 0 &&
+            r->instance_id == instance_id)) && (name == NULL || streq(name, MATCH_ANY) ||
+            streq(r->name, name)))
                 remove_rule(r);
 
         r = next;
@@ -113,6 +247,7 @@ make_rule_consequence(void)
     rc->layer = NULL;
     rc->state = NULL;
     rc->rect = NULL;
+    rc->props = NULL;
 
     return rc;
 }
@@ -125,12 +260,31 @@ make_pending_rule(int fd, xcb_window_t win, rule_consequence_t *csq)
     pr->prev = pr->next = NULL;
     pr->event_head = pr->event_tail = NULL;
     pr->fd = fd;
+    pr->deadline = 0;
     pr->win = win;
     pr->csq = csq;
+    pr->source = NULL;
 
     return pr;
 }
 
+static void
+finish_pending_rule(pending_rule_t *pr)
+{
+    if (manage_window(pr->win, pr->csq, pr->fd)) {
+        for (event_queue_t *eq = pr->event_head; eq != NULL; eq = eq->next)
+            handle_event(&eq->event);
+    }
+
+    remove_pending_rule(pr);
+}
+
+void
+handle_pending_rule(event_source_t *src, uint32_t events)
+{
+    finish_pending_rule(src->data);
+}
+
 void
 add_pending_rule(pending_rule_t *pr)
 {
@@ -144,6 +298,8 @@ add_pending_rule(pending_rule_t *pr)
         pr->prev = pending_rule_tail;
         pending_rule_tail = pr;
     }
+
+    pr->source = loop_add(pr->fd, EPOLLIN, handle_pending_rule, pr);
 }
 
 void
@@ -167,8 +323,11 @@ remove_pending_rule(pending_rule_t *pr)
     if (pr == pending_rule_tail)
         pending_rule_tail = a;
 
-    close(pr->fd);
-    free(pr->fd);
+    loop_remove(pr->source);
+
+    if (pr->fd != -1)
+        close(pr->fd);
+
     event_queue_t *eq = pr->event_head;
 
     while (eq != NULL) {
@@ -180,6 +339,44 @@ remove_pending_rule(pending_rule_t *pr)
     free(pr);
 }
 
+int
+rule_timeout(void)
+{
+    int64_t timeout = -1;
+    uint64_t now = monotonic_ms();
+
+    for (pending_rule_t *pr = pending_rule_head; pr != NULL; pr = pr->next) {
+        if (pr->fd != -1)
+            continue;
+
+        int64_t delay = (pr->deadline <= now ? 0 : (int64_t) (pr->deadline - now));
+
+        if (timeout == -1 || delay < timeout)
+            timeout = delay;
+    }
+
+    return (int) timeout;
+}
+
+void
+rule_expire(void)
+{
+    uint64_t now = monotonic_ms();
+    pending_rule_t *pr = pending_rule_head;
+
+    while (pr != NULL) {
+        pending_rule_t *next = pr->next;
+
+        if (pr->fd == -1 && pr->deadline <= now) {
+            warn("[!] WARNING: lowm: No answer from the external rules daemon for 0x%08X\n",
+                pr->win);
+            finish_pending_rule(pr);
+        }
+
+        pr = next;
+    }
+}
+
 void
 postpone_event(pending_rule_t *pr, xcb_generic_event_t *evt)
 {
@@ -216,9 +413,9 @@ make_event_queue(xcb_generic_event_t *evt)
 #define SET_CSQ_STATE(val)                                                  \
     do {                                                                    \
         if (csq->state == NULL)                                             \
-            csq->layer = calloc(1, sizeof(stack_layer_t));                  \
+            csq->state = calloc(1, sizeof(client_state_t));                 \
                                                                             \
-        *(csq->layer) = (val);                                              \
+        *(csq->state) = (val);                                              \
     } while (0)
 
 #define SET_CSQ_LAYER(val)                                                  \
@@ -230,151 +427,439 @@ make_event_queue(xcb_generic_event_t *evt)
     } while (0)
 
 void
-_apply_window_type(xcb_window_t win, rule_consequence_t *csq)
+_apply_window_type(window_props_t *wp, rule_consequence_t *csq)
 {
-    xcb_ewmh_get_atoms_reply_t win_type;
     unsigned int i;
 
-    if (xcb_ewmh_get_wm_window_type_reply(ewmh, xcb_ewmh_get_wm_window_type(ewmh, win),
-        &win_state, NULL) == 1) {
-            for (i = 0; i < win_state.atoms_len; i++) {
-                xcb_atom_t win_state.atoms[i];
-
-                if (a == ewmh->_NET_WM_STATE_FULLSCREEN)
-                    SET_CSQ_STATE(STATE_FULLSCREEN);
-                else if (a == ewmh->_NET_WM_STATE_BELOW)
-                    SET_CSQ_LAYER(LAYER_BELOW);
-                else if (a == ewmh->_NET_WM_STATE_ABOVE)
-                    SET_CSQ_LAYER(LAYER_ABOVE);
-                else if (a == eqmh->_NET_WM_STATE_STICKY)
-                    csq->sticky = true;
-            }
+    if (wp->has_window_type) {
+        for (i = 0; i < wp->window_type.atoms_len; i++) {
+            xcb_atom_t a = wp->window_type.atoms[i];
 
-            xcb_ewmh_get_atoms_reply_wipe(&win_state);
+            if (a == ewmh->_NET_WM_STATE_FULLSCREEN)
+                SET_CSQ_STATE(STATE_FULLSCREEN);
+            else if (a == ewmh->_NET_WM_STATE_BELOW)
+                SET_CSQ_LAYER(LAYER_BELOW);
+            else if (a == ewmh->_NET_WM_STATE_ABOVE)
+                SET_CSQ_LAYER(LAYER_ABOVE);
+            else if (a == ewmh->_NET_WM_STATE_STICKY)
+                csq->sticky = true;
+        }
     }
 }
 
 void
-_apply_window_state(xcb_window_t win, rule_consequence_t *csq)
+_apply_window_state(window_props_t *wp, rule_consequence_t *csq)
 {
-    xcb_ewmh_get_atoms_reply_t win_state;
     unsigned int i;
 
-    if (xcb_ewmh_get_wm_state_reply(ewmh, xcb_ewmh_get_wm_state(ewmh, win), &win_state, NULL) == 1) {
-        for (i = 0; i < win_state.atoms_len; i++) {
-            xcb_atom_t a = win_state.atoms[i];
+    if (wp->has_wm_state) {
+        for (i = 0; i < wp->wm_state.atoms_len; i++) {
+            xcb_atom_t a = wp->wm_state.atoms[i];
 
             if (a == ewmh->_NET_WM_STATE_FULLSCREEN)
                 SET_CSQ_STATE(STATE_FULLSCREEN);
             else if (a == ewmh->_NET_WM_STATE_BELOW)
-                SET_CSQ_LAYER(LAYER_BELOW)
+                SET_CSQ_LAYER(LAYER_BELOW);
             else if (a == ewmh->_NET_WM_STATE_ABOVE)
                 SET_CSQ_LAYER(LAYER_ABOVE);
             else if (a == ewmh->_NET_WM_STATE_STICKY)
                 csq->sticky = true;
         }
-
-        xcb_ewmh_get_atoms_reply_wipe(&win_state);
     }
 }
 
 void
-_apply_transient(xcb_window_t win, rule_consequence_t *csq)
+_apply_transient(window_props_t *wp, rule_consequence_t *csq)
 {
-    xcb_window_t transient_for = XCB_NONE;
-
-    xcb_icccm_get_wm_transient_for_reply(dpy, xcb_icccm_get_wm_transient_for(dpy, win),
-        &transient_for, NULL);
-
-    if (transient_for != XCB_NONE)
+    if (wp->transient_for != XCB_NONE)
         SET_CSQ_STATE(STATE_FLOATING);
 }
 
 void
-_apply_hints(xcb_window_t win, rule_consequence_t *csq)
+_apply_hints(window_props_t *wp, rule_consequence_t *csq)
 {
-    xcb_size_hints_t size_hints;
-
-    if (xcb_icccm_get_wm_normal_hints_reply(dpy, xcb_icccm_get_wm_hints(dpy, win),
-        &size_hints, NULL) == 1) {
-
-        if ((size_hints.flags & (XCB_ICCCM_SIZE_HINT_P_MIN_SIZE | XCB_ICCCM_SIZE_HINT_P_MAX_SIZE))
-            && size.hints.min_width == size_hints.max_width && size_hints.min_height ==
-            size_hints.max_height)
-                SET_CSQ_STATE(STATE_FLOATING);
+    xcb_size_hints_t *size_hints = &wp->size_hints;
 
-    }
+    if (wp->has_size_hints && (size_hints->flags & (XCB_ICCCM_SIZE_HINT_P_MIN_SIZE |
+        XCB_ICCCM_SIZE_HINT_P_MAX_SIZE)) && size_hints->min_width == size_hints->max_width &&
+        size_hints->min_height == size_hints->max_height)
+            SET_CSQ_STATE(STATE_FLOATING);
 }
 
 void
-_apply_class(xcb_window_t win, rule_consequence_t *csq)
+_apply_class(window_props_t *wp, rule_consequence_t *csq)
 {
-    xcb_icccm_get_wm_class_reply_t reply;
-
-    if (xcb_icccm_get_wm_class_reply(dpy, xcb_icccm_get_wm_class(dpy, win), &reply, NULL) == 1) {
-        snprintf(csq->class_name, sizeof(csq->class_name), "%s", reply.class_name);
-        snprintf(csq->instance_name, sizeof(csq->instance_name), "%s", reply.instance_name);
-        xcb_icccm_get_wm_class_reply_wipe(&reply);
+    if (wp->has_class) {
+        intern_release(csq->class_id);
+        intern_release(csq->instance_id);
+        csq->class_id = intern(wp->wm_class.class_name);
+        csq->instance_id = intern(wp->wm_class.instance_name);
     }
 }
 
 void
-_apply_name(xcb_window_t win, rule_consequence_t *csq)
+_apply_name(window_props_t *wp, rule_consequence_t *csq)
 {
-    xcb_icccm_get_text_property_reply_t reply;
-
-    if (xcb_icccm_get_wm_name_reply(dpy, xcb_icccm_get_wm_name(dpy, win), &reply, NULL) == 1) {
-        snprintf(csq->name, sizeof(csq->name), "%s", reply.name);
-        xcb_icccm_get_text_property_reply_wipe(&reply);
-    }
+    if (wp->has_name)
+        snprintf(csq->name, sizeof(csq->name), "%.*s", (int) wp->wm_name.name_len, wp->wm_name.name);
 }
 
 void
-parse_key_values(char *buf, rule_consequence_t *csq)
+compile_key_values(char *buf, rule_effect_t *e)
 {
     char *key = strtok(buf, CSQ_BLK);
     char *value = strtok(NULL, CSQ_BLK);
 
     while (key != NULL && value != NULL) {
-        parse_key_values(key, value, csq);
+        parse_key_value(key, value, e);
         key = strtok(NULL, CSQ_BLK);
         value = strtok(NULL, CSQ_BLK);
     }
 }
 
+void
+parse_key_values(char *buf, rule_consequence_t *csq)
+{
+    rule_effect_t e;
+
+    memset(&e, 0, sizeof(e));
+    compile_key_values(buf, &e);
+    apply_rule_effect(&e, csq);
+}
+
 void
 apply_rules(xcb_window_t win, rule_consequence_t *csq)
 {
-    _apply_window_type(win, csq);
-    _apply_window_state(win, csq);
-    _apply_transient(win, csq);
-    _apply_hints(win, csq);
-    _apply_class(win, csq);
-    _apply_name(win, csq);
-
-    rule_t *rule = rule_head;
-
-    while (rule != NULL) {
-        rule_t *next = rule->next;
-
-        if ((streq(rule->class_name, MATCH_ANY) || streq(rule->class_name, csq->class_name)) &&
-            (streq(rule->instance_name, MATCH_ANY) || streq(rule->instance_name,
-            csq->instance_name)) && (streq(rule->name, MATCH_ANY) || streq(rule->name,
-            csq->name))) {
-                char effect[MAXLEN];
-                snprintf(effect, sizeof(effect), "%s", rule->effect);
-                parse_keys_values(effect, csq);
-
-                if (rule->one_shot) {
-                    remove_rule(rule);
-                    break;
-                }
+    if (csq->props == NULL)
+        csq->props = fetch_window_props(win);
+
+    window_props_t *wp = csq->props;
+
+    if (wp != NULL) {
+        _apply_window_type(wp, csq);
+        _apply_window_state(wp, csq);
+        _apply_transient(wp, csq);
+        _apply_hints(wp, csq);
+        _apply_class(wp, csq);
+        _apply_name(wp, csq);
+    }
+
+    /* The rules that could match, in the order they were added. */
+    uint32_t any = intern_find(MATCH_ANY);
+    rule_bucket_t *buckets[] = {
+        find_rule_bucket(csq->class_id, csq->instance_id, false),
+        any != 0 ? find_rule_bucket(csq->class_id, any, false) : NULL,
+        any != 0 ? find_rule_bucket(any, csq->instance_id, false) : NULL,
+        any != 0 ? find_rule_bucket(any, any, false) : NULL,
+    };
+    rule_t *cur[LENGTH(buckets)];
+    unsigned int i, j;
+
+    for (i = 0; i < LENGTH(buckets); i++) {
+        for (j = 0; j < i && buckets[j] != buckets[i]; j++)
+            ;
+
+        cur[i] = (buckets[i] != NULL && j == i ? buckets[i]->head : NULL);
+    }
+
+    for (;;) {
+        rule_t *rule = NULL;
+        unsigned int k = 0;
+
+        for (i = 0; i < LENGTH(cur); i++) {
+            if (cur[i] != NULL && (rule == NULL || cur[i]->seq < rule->seq)) {
+                rule = cur[i];
+                k = i;
+            }
+        }
+
+        if (rule == NULL)
+            break;
+
+        cur[k] = rule->bucket_next;
+
+        if (!streq(rule->name, MATCH_ANY) && !streq(rule->name, csq->name))
+            continue;
+
+        apply_rule_effect(&rule->delta, csq);
+
+        if (rule->one_shot) {
+            remove_rule(rule);
+            break;
+        }
+    }
+}
+
+/**
+ * In daemon mode, the external rules command is started once and reads
+ * one request per line on its standard input:
+ *
+ *     <wid> <class_name> <instance_name> <consequence>
+ *
+ * where blanks and backslashes within the names are preceded by a
+ * backslash, and newlines are written as \n. For each of them it writes
+ * back, in any order, a line of at most RULES_DAEMON_LINE_MAX bytes
+ * starting with the same window id followed by the key=value pairs to
+ * apply. The windows it hasn't answered for are parked as pending rules
+ * without a descriptor, for RULES_DAEMON_TIMEOUT milliseconds at most.
+**/
+static int daemon_in = -1;
+static int daemon_out = -1;
+static event_source_t *daemon_source = NULL;
+static char *daemon_buf = NULL;
+static size_t daemon_len = 0;
+static size_t daemon_cap = 0;
+
+static void handle_rules_daemon(event_source_t *src, uint32_t events);
+
+void
+stop_rules_daemon(void)
+{
+    loop_remove(daemon_source);
+    daemon_source = NULL;
+
+    if (daemon_in != -1)
+        close(daemon_in);
+
+    if (daemon_out != -1)
+        close(daemon_out);
+
+    daemon_in = daemon_out = -1;
+    free(daemon_buf);
+    daemon_buf = NULL;
+    daemon_len = daemon_cap = 0;
+
+    /* Nobody is going to answer for them anymore. */
+    pending_rule_t *pr = pending_rule_head;
+
+    while (pr != NULL) {
+        pending_rule_t *next = pr->next;
+
+        if (pr->fd == -1)
+            finish_pending_rule(pr);
+
+        pr = next;
+    }
+}
+
+static bool
+start_rules_daemon(void)
+{
+    int to_daemon[2], from_daemon[2];
+
+    if (pipe2(to_daemon, O_CLOEXEC) == -1)
+        return false;
+
+    if (pipe2(from_daemon, O_CLOEXEC) == -1) {
+        close(to_daemon[0]);
+        close(to_daemon[1]);
+
+        return false;
+    }
+
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        if (dpy != NULL)
+            close(xcb_get_file_descriptor(dpy));
+
+        restore_signals();
+        dup2(to_daemon[0], 0);
+        dup2(from_daemon[1], 1);
+        setsid();
+
+        execl(external_rules_command, external_rules_command, (char *)NULL);
+        err("Couldn't spawn rule command\n");
+    }
+
+    close(to_daemon[0]);
+    close(from_daemon[1]);
+
+    if (pid == -1) {
+        close(to_daemon[1]);
+        close(from_daemon[0]);
+
+        return false;
+    }
+
+    daemon_in = to_daemon[1];
+    daemon_out = from_daemon[0];
+    fcntl(daemon_in, F_SETFL, fcntl(daemon_in, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(daemon_out, F_SETFL, fcntl(daemon_out, F_GETFL, 0) | O_NONBLOCK);
+
+    if ((daemon_source = loop_add(daemon_out, EPOLLIN, handle_rules_daemon, NULL)) == NULL) {
+        stop_rules_daemon();
+
+        return false;
+    }
+
+    return true;
+}
+
+static void
+answer_pending_rule(char *line)
+{
+    char *end;
+    xcb_window_t win = strtoul(line, &end, 0);
+
+    if (end == line)
+        return;
+
+    for (pending_rule_t *pr = pending_rule_head; pr != NULL; pr = pr->next) {
+        if (pr->fd == -1 && pr->win == win) {
+            parse_key_values(end, pr->csq);
+            finish_pending_rule(pr);
+
+            return;
+        }
+    }
+}
+
+/* Returns false if answering brought the daemon down. */
+static bool
+answer_pending_rules(void)
+{
+    size_t start = 0;
+    char *nl;
+
+    while ((nl = memchr(daemon_buf + start, '\n', daemon_len - start)) != NULL) {
+        *nl = '\0';
+        answer_pending_rule(daemon_buf + start);
+        start = nl - daemon_buf + 1;
+
+        if (daemon_buf == NULL)
+            return false;
+    }
+
+    memmove(daemon_buf, daemon_buf + start, daemon_len - start);
+    daemon_len -= start;
+
+    return true;
+}
+
+static void
+handle_rules_daemon(event_source_t *src, uint32_t events)
+{
+    for (;;) {
+        if (daemon_cap - daemon_len < BUFSIZ && daemon_cap < RULES_DAEMON_LINE_MAX) {
+            size_t cap = (daemon_cap == 0 ? BUFSIZ : 2 * daemon_cap);
+
+            if (cap > RULES_DAEMON_LINE_MAX)
+                cap = RULES_DAEMON_LINE_MAX;
+
+            char *buf = realloc(daemon_buf, cap);
+
+            if (buf == NULL) {
+                perror("rule: realloc");
+                stop_rules_daemon();
+
+                return;
+            }
+
+            daemon_buf = buf;
+            daemon_cap = cap;
+        }
+
+        /* What's left is a single line, without its end. */
+        if (daemon_len + 1 >= daemon_cap) {
+            warn("[!] WARNING: lowm: The external rules daemon sent a line longer than %i "
+                "bytes\n", RULES_DAEMON_LINE_MAX);
+            stop_rules_daemon();
+
+            return;
+        }
+
+        ssize_t n = read(daemon_out, daemon_buf + daemon_len, daemon_cap - daemon_len - 1);
+
+        if (n > 0) {
+            daemon_len += n;
+
+            if (!answer_pending_rules())
+                return;
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            warn("[!] WARNING: lowm: The external rules daemon went away\n");
+            stop_rules_daemon();
+
+            return;
+        }
+    }
+}
+
+/* Keep the fields of a request apart, whatever the names contain. */
+static void
+fprint_escaped(FILE *f, const char *s)
+{
+    for (; *s != '\0'; s++) {
+        if (*s == '\n') {
+            fputs("\\n", f);
+
+            continue;
         }
 
-        rule = next;
+        if (*s == ' ' || *s == '\t' || *s == '\\')
+            fputc('\\', f);
+
+        fputc(*s, f);
     }
 }
 
+static bool
+query_rules_daemon(xcb_window_t win, rule_consequence_t *csq)
+{
+    if (daemon_source == NULL && !start_rules_daemon())
+        return false;
+
+    char *csq_buf = NULL;
+    char *line = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&line, &len);
+
+    if (f == NULL) {
+        perror("rule: open_memstream");
+
+        return false;
+    }
+
+    print_rule_consequence(&csq_buf, csq);
+    fprintf(f, "%u ", win);
+    fprint_escaped(f, intern_str(csq->class_id));
+    fputc(' ', f);
+    fprint_escaped(f, intern_str(csq->instance_id));
+    fprintf(f, " %s\n", csq_buf != NULL ? csq_buf : "");
+    fclose(f);
+    free(csq_buf);
+
+    /* Writes of at most PIPE_BUF bytes are never split. */
+    bool sent = false;
+    bool broken = false;
+
+    if (len <= PIPE_BUF) {
+        ssize_t n = write(daemon_in, line, len);
+
+        sent = (n >= 0 && (size_t) n == len);
+        broken = (n == -1 && errno == EPIPE);
+    }
+
+    free(line);
+
+    if (broken)
+        stop_rules_daemon();
+
+    if (!sent)
+        return false;
+
+    pending_rule_t *pr = make_pending_rule(-1, win, csq);
+
+    pr->deadline = monotonic_ms() + RULES_DAEMON_TIMEOUT;
+    add_pending_rule(pr);
+
+    return true;
+}
+
 bool
 schedule_rules(xcb_window_t win, rule_consequence_t *csq)
 {
@@ -382,6 +867,10 @@ schedule_rules(xcb_window_t win, rule_consequence_t *csq)
         return false;
 
     resolve_rule_consequence(csq);
+
+    if (external_rules_daemon)
+        return query_rules_daemon(win, csq);
+
     int fds[2];
 
     if (pipe(fds) == -1)
@@ -393,6 +882,7 @@ schedule_rules(xcb_window_t win, rule_consequence_t *csq)
         if (dpy != NULL)
             close(xcb_get_file_descriptor(dpy));
 
+        restore_signals();
         dup2(fds[1], 1);
         close(fds[0]);
 
@@ -403,8 +893,8 @@ schedule_rules(xcb_window_t win, rule_consequence_t *csq)
         snprintf(wid, sizeof(wid), "%i", win);
         setsid();
 
-        execl(external_rules_command, external_rules_command, wid, csq->class_name,
-            csq->instance_name, csq_buf, NULL);
+        execl(external_rules_command, external_rules_command, wid,
+            intern_str(csq->class_id), intern_str(csq->instance_id), csq_buf, NULL);
         free(csq_buf);
         err("Couldn't spawm rule command\n");
     } else if (pid > 0) {
@@ -433,63 +923,123 @@ parse_rule_consequence(int fd, rule_consequence_t *csq)
 }
 
 void
-parse_key_value(char *key, char *value, rule_consequence_t *csq)
+parse_key_value(char *key, char *value, rule_effect_t *e)
 {
     bool v;
 
     if (streq("monitor", key)) {
-        snprintf(csq->monitor_desc, sizeof(csq->monitor_desc), "%s", value);
+        snprintf(e->monitor_desc, sizeof(e->monitor_desc), "%s", value);
+        e->mask |= RULE_EFFECT_MONITOR;
     } else if (streq("desktop", key)) {
-        snprintf(csq->desktop_desc, sizeof(csq->desktop_desc), "%s", value);
+        snprintf(e->desktop_desc, sizeof(e->desktop_desc), "%s", value);
+        e->mask |= RULE_EFFECT_DESKTOP;
     } else if (streq("node", key)) {
-        snprintf(csq->node_dsec, sizeof(csq->node_desc), "%s", value);
+        snprintf(e->node_desc, sizeof(e->node_desc), "%s", value);
+        e->mask |= RULE_EFFECT_NODE;
     } else if (streq("split_dir", key)) {
-        direction_t dir;
-
-        if (parse_direction(value, &dir))
-            SET_CSQ_SPLIT_DIR(dir);
+        if (parse_direction(value, &e->split_dir))
+            e->mask |= RULE_EFFECT_SPLIT_DIR;
     } else if (streq("state", key)) {
-        client_state_t cst;
-
-        if (parse_client_state(value, &cst))
-            SET_CSQ_STATE(cst);
+        if (parse_client_state(value, &e->state))
+            e->mask |= RULE_EFFECT_STATE;
     } else if (streq("layer", key)) {
-        stack_layer_t lyr;
-
-        if (parse_stack_layer(value, &lyr))
-            SET_CSQ_LAYER(lyr);
+        if (parse_stack_layer(value, &e->layer))
+            e->mask |= RULE_EFFECT_LAYER;
     } else if (streq("split_ratio", key)) {
         double rat;
 
-        if (sscanf(value, "%lf", &rat) == 1 && rat > 0 && rat < 1)
-            csq->split_ratio = rat;
-    } else if (streq("rectangle", key)) {
-        if (csq->rect == NULL)
-            csq->rect = calloc(1, sizeof(xcb_rectangle_t));
-
-        if (!parse_rectangle(value, csq->rect)) {
-            free(csq->rect);
-            csq->rect = NULL;
+        if (sscanf(value, "%lf", &rat) == 1 && rat > 0 && rat < 1) {
+            e->split_ratio = rat;
+            e->mask |= RULE_EFFECT_SPLIT_RATIO;
         }
+    } else if (streq("rectangle", key)) {
+        e->rect_valid = parse_rectangle(value, &e->rect);
+        e->mask |= RULE_EFFECT_RECTANGLE;
     } else if (parse_bool(value, &v)) {
+        uint32_t f = 0;
+
         if (streq("hidden", key))
-            csq->hidden = v;
+            f = RULE_EFFECT_HIDDEN;
 
-#define SETCSQ(name)                                                        \
+#define EFFECT_FLAG(name, flag)                                             \
         else if (streq(#name, key))                                         \
-            csq->name = v;                                                  \
+            f = flag;
+
+        EFFECT_FLAG(sticky, RULE_EFFECT_STICKY)
+        EFFECT_FLAG(private, RULE_EFFECT_PRIVATE)
+        EFFECT_FLAG(locked, RULE_EFFECT_LOCKED)
+        EFFECT_FLAG(marked, RULE_EFFECT_MARKED)
+        EFFECT_FLAG(center, RULE_EFFECT_CENTER)
+        EFFECT_FLAG(follow, RULE_EFFECT_FOLLOW)
+        EFFECT_FLAG(manage, RULE_EFFECT_MANAGE)
+        EFFECT_FLAG(focus, RULE_EFFECT_FOCUS)
+        EFFECT_FLAG(border, RULE_EFFECT_BORDER)
+#undef EFFECT_FLAG
+
+        e->mask |= f;
+
+        if (v)
+            e->on |= f;
+        else
+            e->on &= ~f;
+    }
+}
 
-        SETCSQ(sticky)
-        SETCSQ(private)
-        SETCSQ(locked)
-        SETCSQ(marked)
-        SETCSQ(center)
-        SETCSQ(follow)
-        SETCSQ(manage)
-        SETCSQ(focus)
-        SETCSQ(border)
-#undef SETCSQ
+/* Only the fields the effect sets are touched. */
+void
+apply_rule_effect(rule_effect_t *e, rule_consequence_t *csq)
+{
+    if (e->mask == 0)
+        return;
+
+    if (e->mask & RULE_EFFECT_MONITOR)
+        snprintf(csq->monitor_desc, sizeof(csq->monitor_desc), "%s", e->monitor_desc);
+
+    if (e->mask & RULE_EFFECT_DESKTOP)
+        snprintf(csq->desktop_desc, sizeof(csq->desktop_desc), "%s", e->desktop_desc);
+
+    if (e->mask & RULE_EFFECT_NODE)
+        snprintf(csq->node_desc, sizeof(csq->node_desc), "%s", e->node_desc);
+
+    if (e->mask & RULE_EFFECT_SPLIT_DIR)
+        SET_CSQ_SPLIT_DIR(e->split_dir);
+
+    if (e->mask & RULE_EFFECT_SPLIT_RATIO)
+        csq->split_ratio = e->split_ratio;
+
+    if (e->mask & RULE_EFFECT_STATE)
+        SET_CSQ_STATE(e->state);
+
+    if (e->mask & RULE_EFFECT_LAYER)
+        SET_CSQ_LAYER(e->layer);
+
+    if (e->mask & RULE_EFFECT_RECTANGLE) {
+        if (e->rect_valid) {
+            if (csq->rect == NULL)
+                csq->rect = calloc(1, sizeof(xcb_rectangle_t));
+
+            *csq->rect = e->rect;
+        } else {
+            free(csq->rect);
+            csq->rect = NULL;
+        }
     }
+
+#define APPLY_FLAG(name, flag)                                              \
+    if (e->mask & flag)                                                     \
+        csq->name = (e->on & flag) != 0;
+
+    APPLY_FLAG(hidden, RULE_EFFECT_HIDDEN)
+    APPLY_FLAG(sticky, RULE_EFFECT_STICKY)
+    APPLY_FLAG(private, RULE_EFFECT_PRIVATE)
+    APPLY_FLAG(locked, RULE_EFFECT_LOCKED)
+    APPLY_FLAG(marked, RULE_EFFECT_MARKED)
+    APPLY_FLAG(center, RULE_EFFECT_CENTER)
+    APPLY_FLAG(follow, RULE_EFFECT_FOLLOW)
+    APPLY_FLAG(manage, RULE_EFFECT_MANAGE)
+    APPLY_FLAG(focus, RULE_EFFECT_FOCUS)
+    APPLY_FLAG(border, RULE_EFFECT_BORDER)
+#undef APPLY_FLAG
 }
 
 #undef SET_CSQ_LAYER
@@ -501,6 +1051,6 @@ list_rules(FILE *rsp)
     rule_t *r;
 
     for (*r = rule_head; r != NULL; r = r->next)
-        fprintf(rsp, "%s:%s:%s %c> %s\n", r->class_name, r->instance_name, r->name,
-            r->one_shot ? '-' : '=', r->effect);
+        fprintf(rsp, "%s:%s:%s %c> %s\n", intern_str(r->class_id),
+            intern_str(r->instance_id), r->name, r->one_shot ? '-' : '=', r->effect);
 }
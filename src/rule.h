@@ -0,0 +1,65 @@
+/**
+ * LOWM: An advanced tiling window manager for Unix.
+ *
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/rule.h }.
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * Refer to the file LICENSE for additional details.
+**/
+
+#ifndef LOWM_RULE_H
+#define LOWM_RULE_H
+
+#define MATCH_ANY "*"
+#define RULE_BUCKETS 256
+#define RULES_DAEMON_TIMEOUT 5000
+#define RULES_DAEMON_LINE_MAX (1 << 16)
+
+/**
+ * Whoever fills in a rule gives it the interned ids of its class and
+ * instance names, MATCH_ANY included: the wildcard buckets are only
+ * looked at once MATCH_ANY has been interned. A rule left with id 0 is
+ * listed but matches no window.
+**/
+rule_t *make_rule(void);
+void add_rule(rule_t *r);
+void remove_rule(rule_t *r);
+void remove_rule_by_cause(char *cause);
+bool remove_rule_by_index(int idx);
+rule_consequence_t *make_rule_consequence(void);
+pending_rule_t *make_pending_rule(int fd, xcb_window_t win, rule_consequence_t *csq);
+void handle_pending_rule(event_source_t *src, uint32_t events);
+void add_pending_rule(pending_rule_t *pr);
+void remove_pending_rule(pending_rule_t *pr);
+
+/**
+ * How long until the daemon's answer for the oldest pending window is
+ * overdue, and managing the windows whose answers are, with what the
+ * rules gave them.
+**/
+int rule_timeout(void);
+void rule_expire(void);
+
+/**
+ * Stop the rules daemon, if it's running, and manage the windows it
+ * hasn't answered for yet. It's started again for the next window.
+**/
+void stop_rules_daemon(void);
+
+void postpone_event(pending_rule_t *pr, xcb_generic_event_t *evt);
+event_queue_t *make_event_queue(xcb_generic_event_t *evt);
+void _apply_window_type(window_props_t *wp, rule_consequence_t *csq);
+void _apply_window_state(window_props_t *wp, rule_consequence_t *csq);
+void _apply_transient(window_props_t *wp, rule_consequence_t *csq);
+void _apply_hints(window_props_t *wp, rule_consequence_t *csq);
+void _apply_class(window_props_t *wp, rule_consequence_t *csq);
+void _apply_name(window_props_t *wp, rule_consequence_t *csq);
+void compile_key_values(char *buf, rule_effect_t *e);
+void parse_key_values(char *buf, rule_consequence_t *csq);
+void apply_rules(xcb_window_t win, rule_consequence_t *csq);
+bool schedule_rules(xcb_window_t win, rule_consequence_t *csq);
+void parse_rule_consequence(int fd, rule_consequence_t *csq);
+void parse_key_value(char *key, char *value, rule_effect_t *e);
+void apply_rule_effect(rule_effect_t *e, rule_consequence_t *csq);
+void list_rules(FILE *rsp);
+
+#endif
@@ -0,0 +1,225 @@
+/**
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/selector.c }
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * See the file LICENSE for details.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lowm.h"
+#include "parse.h"
+#include "query.h"
+#include "selector.h"
+
+static selector_t cache[SELECTOR_CACHE_SIZE];
+static size_t cache_len = 0;
+static uint64_t ticks = 0;
+
+/* The forms that are left to the full parser in query.c. */
+static bool
+compilable(selector_kind_t kind, char *desc)
+{
+    if (*desc == '%' || strlen(desc) >= SELECTOR_TEXT_MAX)
+        return false;
+
+    if (kind == SELECTOR_NODE)
+        return (strchr(desc, '@') == NULL && strchr(desc, ':') == NULL);
+
+    if (kind == SELECTOR_DESKTOP) {
+        char *hash = strrchr(desc, '#');
+
+        return (strchr(hash != NULL ? hash + 1 : desc, ':') == NULL);
+    }
+
+    return true;
+}
+
+/* What's left of a name, index or id, after any reference and the modifiers. */
+static void
+compile_lookup(selector_t *s, char *desc)
+{
+    s->op = SELECTOR_OP_LOOKUP;
+    s->has_idx = parse_index(desc, &s->idx);
+    s->has_id = parse_id(desc, &s->id);
+    s->name = desc;
+}
+
+static void
+compile_node(selector_t *s, char *desc)
+{
+    s->sel.node = make_node_select();
+
+    if (!parse_node_modifiers(desc, &s->sel.node))
+        s->op = SELECTOR_OP_BAD_MODIFIERS;
+    else if (parse_direction(desc, &s->dir))
+        s->op = SELECTOR_OP_DIRECTION;
+    else if (parse_cycle_direction(desc, &s->cyc))
+        s->op = SELECTOR_OP_CYCLE;
+    else if (parse_history_direction(desc, &s->hdi))
+        s->op = SELECTOR_OP_HISTORY;
+    else if (streq("any", desc))
+        s->op = SELECTOR_OP_ANY;
+    else if (streq("first_ancestor", desc))
+        s->op = SELECTOR_OP_FIRST_ANCESTOR;
+    else if (streq("last", desc))
+        s->op = SELECTOR_OP_LAST;
+    else if (streq("newest", desc))
+        s->op = SELECTOR_OP_NEWEST;
+    else if (streq("biggest", desc))
+        s->op = SELECTOR_OP_BIGGEST;
+    else if (streq("smallest", desc))
+        s->op = SELECTOR_OP_SMALLEST;
+    else if (streq("pointed", desc))
+        s->op = SELECTOR_OP_POINTED;
+    else if (streq("focused", desc))
+        s->op = SELECTOR_OP_FOCUSED;
+    else if ((s->has_id = parse_id(desc, &s->id)))
+        s->op = SELECTOR_OP_LOOKUP;
+    else
+        s->op = SELECTOR_OP_BAD_DESCRIPTOR;
+}
+
+static void
+compile_desktop(selector_t *s, char *desc)
+{
+    s->sel.desktop = make_desktop_select();
+
+    if (!parse_desktop_modifiers(desc, &s->sel.desktop))
+        s->op = SELECTOR_OP_BAD_MODIFIERS;
+    else if (parse_cycle_direction(desc, &s->cyc))
+        s->op = SELECTOR_OP_CYCLE;
+    else if (parse_history_direction(desc, &s->hdi))
+        s->op = SELECTOR_OP_HISTORY;
+    else if (streq("any", desc))
+        s->op = SELECTOR_OP_ANY;
+    else if (streq("last", desc))
+        s->op = SELECTOR_OP_LAST;
+    else if (streq("newest", desc))
+        s->op = SELECTOR_OP_NEWEST;
+    else if (streq("focused", desc))
+        s->op = SELECTOR_OP_FOCUSED;
+    else
+        compile_lookup(s, desc);
+}
+
+static void
+compile_monitor(selector_t *s, char *desc)
+{
+    s->sel.monitor = make_monitor_select();
+
+    if (!parse_monitor_modifiers(desc, &s->sel.monitor))
+        s->op = SELECTOR_OP_BAD_MODIFIERS;
+    else if (parse_direction(desc, &s->dir))
+        s->op = SELECTOR_OP_DIRECTION;
+    else if (parse_cycle_direction(desc, &s->cyc))
+        s->op = SELECTOR_OP_CYCLE;
+    else if (parse_history_direction(desc, &s->hdi))
+        s->op = SELECTOR_OP_HISTORY;
+    else if (streq("any", desc))
+        s->op = SELECTOR_OP_ANY;
+    else if (streq("last", desc))
+        s->op = SELECTOR_OP_LAST;
+    else if (streq("newest", desc))
+        s->op = SELECTOR_OP_NEWEST;
+    else if (streq("primary", desc))
+        s->op = SELECTOR_OP_PRIMARY;
+    else if (streq("focused", desc))
+        s->op = SELECTOR_OP_FOCUSED;
+    else if (streq("pointed", desc))
+        s->op = SELECTOR_OP_POINTED;
+    else
+        compile_lookup(s, desc);
+}
+
+/* Split the reference off, and compile what's left, in place. */
+static void
+compile_text(selector_t *s, selector_kind_t kind, char *base)
+{
+    char *sep = strrchr(base, '#');
+
+    if (sep != NULL) {
+        *sep = '\0';
+        s->ref = base;
+        base = sep + 1;
+    }
+
+    if (kind == SELECTOR_NODE)
+        compile_node(s, base);
+    else if (kind == SELECTOR_DESKTOP)
+        compile_desktop(s, base);
+    else
+        compile_monitor(s, base);
+}
+
+static void
+compile(selector_t *s, selector_kind_t kind, char *desc, uint32_t hash)
+{
+    memset(s, 0, sizeof(selector_t));
+    s->kind = kind;
+    s->hash = hash;
+    strcpy(s->key, desc);
+    strcpy(s->buf, desc);
+    compile_text(s, kind, s->buf);
+}
+
+void
+selector_compile(selector_kind_t kind, char *desc, selector_t *dst)
+{
+    memset(dst, 0, sizeof(selector_t));
+    dst->kind = kind;
+    compile_text(dst, kind, desc);
+}
+
+static selector_t *
+victim(void)
+{
+    if (cache_len < SELECTOR_CACHE_SIZE)
+        return &cache[cache_len++];
+
+    selector_t *v = &cache[0];
+
+    for (size_t i = 1; i < cache_len; i++) {
+        if (cache[i].used < v->used)
+            v = &cache[i];
+    }
+
+    return v;
+}
+
+bool
+selector_get(selector_kind_t kind, char *desc, selector_t *dst)
+{
+    if (!compilable(kind, desc))
+        return false;
+
+    uint32_t hash = hash_string(desc);
+    selector_t *s = NULL;
+
+    for (size_t i = 0; i < cache_len; i++) {
+        if (cache[i].hash == hash && cache[i].kind == kind && streq(cache[i].key, desc)) {
+            s = &cache[i];
+            break;
+        }
+    }
+
+    if (s == NULL) {
+        s = victim();
+        compile(s, kind, desc, hash);
+    }
+
+    s->used = ++ticks;
+    *dst = *s;
+
+    /* Point into the copy, so that the entry itself can go away. */
+    if (s->ref != NULL)
+        dst->ref = dst->buf + (s->ref - s->buf);
+
+    if (s->name != NULL)
+        dst->name = dst->buf + (s->name - s->buf);
+
+    return true;
+}
@@ -0,0 +1,87 @@
+/**
+ * LOWM: An advanced tiling window manager for Unix.
+ *
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/selector.h }.
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * Refer to the file LICENSE for additional details.
+**/
+
+#ifndef LOWM_SELECTOR_H
+#define LOWM_SELECTOR_H
+
+#define SELECTOR_CACHE_SIZE 64
+#define SELECTOR_TEXT_MAX 128
+
+typedef enum {
+    SELECTOR_MONITOR,
+    SELECTOR_DESKTOP,
+    SELECTOR_NODE,
+} selector_kind_t;
+
+typedef enum {
+    SELECTOR_OP_DIRECTION,
+    SELECTOR_OP_CYCLE,
+    SELECTOR_OP_HISTORY,
+    SELECTOR_OP_ANY,
+    SELECTOR_OP_FIRST_ANCESTOR,
+    SELECTOR_OP_LAST,
+    SELECTOR_OP_NEWEST,
+    SELECTOR_OP_BIGGEST,
+    SELECTOR_OP_SMALLEST,
+    SELECTOR_OP_PRIMARY,
+    SELECTOR_OP_POINTED,
+    SELECTOR_OP_FOCUSED,
+    SELECTOR_OP_LOOKUP,
+    SELECTOR_OP_BAD_MODIFIERS,
+    SELECTOR_OP_BAD_DESCRIPTOR,
+} selector_op_t;
+
+/**
+ * A descriptor, split and parsed once. The reference (what precedes the
+ * last '#') is kept as text and resolved through the cache in turn, and
+ * a lookup keeps the index, id and name the descriptor could stand for,
+ * in the order they are tried.
+**/
+typedef struct {
+    selector_kind_t kind;
+    uint32_t hash;
+    uint64_t used;
+    char key[SELECTOR_TEXT_MAX];
+    char buf[SELECTOR_TEXT_MAX];
+    char *ref;
+    char *name;
+    selector_op_t op;
+    union {
+        direction_t dir;
+        cycle_dir_t cyc;
+        history_dir_t hdi;
+    };
+    bool has_idx;
+    uint16_t idx;
+    bool has_id;
+    uint32_t id;
+    union {
+        monitor_select_t monitor;
+        desktop_select_t desktop;
+        node_select_t node;
+    } sel;
+} selector_t;
+
+/**
+ * Look up the compiled form of a descriptor, compiling it on a miss and
+ * evicting the least recently used entry when the cache is full. Returns
+ * false for the descriptors that are always parsed from scratch: names
+ * prefixed with '%', node paths, `MONITOR:DESKTOP` forms and anything
+ * longer than SELECTOR_TEXT_MAX. The copy handed back stays valid while
+ * resolving its reference, which may itself evict entries.
+**/
+bool selector_get(selector_kind_t kind, char *desc, selector_t *dst);
+
+/**
+ * Compile a descriptor the cache won't take, or the part of it left once
+ * the forms only the full parser knows have been dealt with. The text is
+ * modified, and must outlive the result, which points into it.
+**/
+void selector_compile(selector_kind_t kind, char *desc, selector_t *dst);
+
+#endif
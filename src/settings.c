@@ -12,6 +12,7 @@
 #include "settings.h"
 
 char external_rules_command[MAXLEN];
+bool external_rules_daemon;
 char status_prefix[MAXLEN];
 
 char normal_border_color[MAXLEN];
@@ -61,6 +62,7 @@ run_config(int run_level)
         if (dpy != NULL)
             close(xcb_get_file_descriptor(dpy));
 
+        restore_signals();
         setsid();
         char arg1[2];
         snprintf(arg1, 2, "%i", run_level);
@@ -74,6 +76,7 @@ void
 load_settings(void)
 {
     snprintf(external_rules_command, sizeof(external_rules_command), "%s", EXTERNAL_RULES_COMMAND);
+    external_rules_daemon = EXTERNAL_RULES_DAEMON;
     snprintf(status_prefix, sizeof(status_prefix), "%s", STATUS_PREFIX);
     snprintf(normal_border_color, sizeof(normal_border_color), "%s", NORMAL_BORDER_COLOR);
     snprintf(active_border_color, sizeof(active_border_color), "%s", ACTIVE_BORDER_COLOR);
@@ -14,6 +14,7 @@
 #define POINTER_MODIFIER XCB_MOD_MASK_4
 #define POINTER_MOTION_INTERVAL 17
 #define EXTERNAL_RULES_COMMAND ""
+#define EXTERNAL_RULES_DAEMON false
 #define STATUS_PREFIX "W"
 
 #define NORMAL_BORDER_COLOR "#30302f"
@@ -53,6 +54,7 @@
 #define MERGE_OVERLAPPING_MONITORS false
 
 extern char external_rules_command[MAXLEN];
+extern bool external_rules_daemon;
 extern char status_prefix[MAXLEN];
 extern char normal_border_color[MAXLEN];
 extern char active_border_color[MAXLEN];
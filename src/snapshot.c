@@ -0,0 +1,201 @@
+/**
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/snapshot.c }
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * See the file LICENSE for details.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "lowm.h"
+#include "desktop.h"
+#include "snapshot.h"
+
+static snapshot_t *region = NULL;
+static char *region_path = NULL;
+
+/* The next snapshot is built here, and only published if it differs. */
+static snapshot_t staging;
+
+static uint8_t
+state_chr(node_t *n)
+{
+    if (n->client == NULL)
+        return SNAPSHOT_NO_STATE;
+
+    switch (n->client->state) {
+    case STATE_TILED:
+        return 'T';
+    case STATE_PSEUDO_TILED:
+        return 'P';
+    case STATE_FLOATING:
+        return 'F';
+    case STATE_FULLSCREEN:
+        return '=';
+    }
+
+    return SNAPSHOT_NO_STATE;
+}
+
+static uint8_t
+snapshot_node_flags(node_t *n)
+{
+    return (n->sticky ? SNAPSHOT_NODE_STICKY : 0) |
+           (n->private ? SNAPSHOT_NODE_PRIVATE : 0) |
+           (n->locked ? SNAPSHOT_NODE_LOCKED : 0) |
+           (n->marked ? SNAPSHOT_NODE_MARKED : 0) |
+           (n->hidden ? SNAPSHOT_NODE_HIDDEN : 0);
+}
+
+static void
+snapshot_build(snapshot_t *s)
+{
+    memset(s, 0, sizeof(snapshot_t));
+    s->magic = SNAPSHOT_MAGIC;
+    s->version = SNAPSHOT_VERSION;
+    s->alive = 1;
+    s->focused_monitor = (mon != NULL ? mon->id : 0);
+
+    for (monitor_t *m = mon_head; m != NULL; m = m->next) {
+        if (s->monitors_count == SNAPSHOT_MAX_MONITORS) {
+            s->truncated = 1;
+            break;
+        }
+
+        snapshot_monitor_t *sm = &s->monitors[s->monitors_count++];
+
+        sm->id = m->id;
+        sm->focused = (m == mon);
+        sm->first_desktop = s->desktops_count;
+        snprintf(sm->name, sizeof(sm->name), "%s", m->name);
+
+        for (desktop_t *d = m->desk_head; d != NULL; d = d->next) {
+            if (s->desktops_count == SNAPSHOT_MAX_DESKTOPS) {
+                s->truncated = 1;
+                break;
+            }
+
+            snapshot_desktop_t *sd = &s->desktops[s->desktops_count++];
+
+            sd->id = d->id;
+            sd->monitor_id = m->id;
+            sd->layout = LAYOUT_CHR(d->layout);
+            sd->flags = (m->desk == d ? SNAPSHOT_DESKTOP_FOCUSED : 0) |
+                        (d->root != NULL ? SNAPSHOT_DESKTOP_OCCUPIED : 0) |
+                        (is_urgent(d) ? SNAPSHOT_DESKTOP_URGENT : 0);
+            snprintf(sd->name, sizeof(sd->name), "%s", d->name);
+            sm->desktops_count++;
+        }
+
+        if (m->desk != NULL) {
+            sm->desktop_id = m->desk->id;
+
+            if (m->desk->focus != NULL) {
+                sm->focus_id = m->desk->focus->id;
+                sm->focus_state = state_chr(m->desk->focus);
+                sm->focus_flags = snapshot_node_flags(m->desk->focus);
+            }
+        }
+    }
+}
+
+/**
+ * The sequence counter is odd for the whole duration of the copy, the
+ * fences keep the stores to the payload between its two increments.
+**/
+static void
+snapshot_publish(snapshot_t *s)
+{
+    uint32_t seq = region->seq;
+
+    __atomic_store_n(&region->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    s->seq = seq + 1;
+    memcpy(region, s, sizeof(snapshot_t));
+
+    __atomic_store_n(&region->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+bool
+snapshot_open(char *path)
+{
+    /* Readers of a previous region keep their mapping, of a file that no longer has a name. */
+    unlink(path);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+    if (fd == -1) {
+        perror("snapshot: open");
+
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(snapshot_t)) == -1) {
+        perror("snapshot: ftruncate");
+        close(fd);
+        unlink(path);
+
+        return false;
+    }
+
+    void *addr = mmap(NULL, sizeof(snapshot_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        perror("snapshot: mmap");
+        unlink(path);
+
+        return false;
+    }
+
+    region = addr;
+    region_path = strdup(path);
+    snapshot_update();
+
+    return true;
+}
+
+/**
+ * Called along with the report: only once per loop iteration, and only
+ * writes to the region when something a reader could see has changed.
+**/
+void
+snapshot_update(void)
+{
+    if (region == NULL)
+        return;
+
+    snapshot_build(&staging);
+    staging.seq = region->seq;
+
+    if (memcmp(&staging, region, sizeof(snapshot_t)) == 0)
+        return;
+
+    snapshot_publish(&staging);
+}
+
+void
+snapshot_close(void)
+{
+    if (region == NULL)
+        return;
+
+    memcpy(&staging, region, sizeof(snapshot_t));
+    staging.alive = 0;
+    snapshot_publish(&staging);
+
+    munmap(region, sizeof(snapshot_t));
+    region = NULL;
+
+    if (region_path != NULL) {
+        unlink(region_path);
+        free(region_path);
+        region_path = NULL;
+    }
+}
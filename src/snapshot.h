@@ -0,0 +1,93 @@
+/**
+ * LOWM: An advanced tiling window manager for Unix.
+ *
+ * Copyright (C) 2021, Eric Londo <londoed@comcast.net>, { src/snapshot.h }.
+ * This software is distributed under the GNU General Public License Version 2.0.
+ * Refer to the file LICENSE for additional details.
+**/
+
+#ifndef LOWM_SNAPSHOT_H
+#define LOWM_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SNAPSHOT_MAGIC 0x6c6f776d
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_MAX_MONITORS 16
+#define SNAPSHOT_MAX_DESKTOPS 128
+#define SNAPSHOT_NAME_LEN 32
+
+typedef enum {
+    SNAPSHOT_DESKTOP_FOCUSED = 1 << 0,
+    SNAPSHOT_DESKTOP_OCCUPIED = 1 << 1,
+    SNAPSHOT_DESKTOP_URGENT = 1 << 2,
+} snapshot_desktop_flags_t;
+
+typedef enum {
+    SNAPSHOT_NODE_STICKY = 1 << 0,
+    SNAPSHOT_NODE_PRIVATE = 1 << 1,
+    SNAPSHOT_NODE_LOCKED = 1 << 2,
+    SNAPSHOT_NODE_MARKED = 1 << 3,
+    SNAPSHOT_NODE_HIDDEN = 1 << 4,
+} snapshot_node_flags_t;
+
+/* The state of a node without a client, as in the `T@` field of the report. */
+#define SNAPSHOT_NO_STATE 0xff
+
+typedef struct {
+    uint32_t id;
+    uint32_t monitor_id;
+    uint8_t flags;
+    uint8_t layout;
+    uint8_t pad[2];
+    char name[SNAPSHOT_NAME_LEN];
+} snapshot_desktop_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t desktop_id;
+    uint32_t first_desktop;
+    uint32_t desktops_count;
+    uint32_t focus_id;
+    uint8_t focus_state;
+    uint8_t focus_flags;
+    uint8_t focused;
+    uint8_t pad;
+    char name[SNAPSHOT_NAME_LEN];
+} snapshot_monitor_t;
+
+/**
+ * The region is a single snapshot_t, only ever written by the window
+ * manager. `seq` is odd while it's being written: a reader copies what it
+ * needs between two loads of `seq` and starts over unless both loads
+ * returned the same even value.
+ *
+ *     do {
+ *         while ((s = __atomic_load_n(&snap->seq, __ATOMIC_ACQUIRE)) & 1)
+ *             ;
+ *         memcpy(&copy, snap, sizeof(copy));
+ *         __atomic_thread_fence(__ATOMIC_ACQUIRE);
+ *     } while (__atomic_load_n(&snap->seq, __ATOMIC_RELAXED) != s);
+ *
+ * A region whose `alive` field is zero was left behind by a window manager
+ * that exited or restarted, and should be mapped again from its path.
+**/
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;
+    uint32_t alive;
+    uint32_t monitors_count;
+    uint32_t desktops_count;
+    uint32_t focused_monitor;
+    uint32_t truncated;
+    snapshot_monitor_t monitors[SNAPSHOT_MAX_MONITORS];
+    snapshot_desktop_t desktops[SNAPSHOT_MAX_DESKTOPS];
+} snapshot_t;
+
+bool snapshot_open(char *path);
+void snapshot_update(void);
+void snapshot_close(void);
+
+#endif
@@ -5,91 +5,97 @@
 **/
 
 #include <stdlib.h>
+#include <stdbool.h>
 
 #include "lowm.h"
 #include "window.h"
 #include "subscribe.h"
 #include "ewmh.h"
+#include "pool.h"
 #include "tree.h"
 #include "stack.h"
 
+/* Three layers of three states each, see stack_level(). */
+#define STACK_LEVELS 9
+
+/**
+ * The stacking list is sorted by level, and each level is a contiguous
+ * segment of it, delimited by these. Each node points at its own entry.
+**/
+static stacking_list_t *level_head[STACK_LEVELS];
+static stacking_list_t *level_tail[STACK_LEVELS];
+
+static pool_t stack_pool = POOL_INIT(stacking_list_t);
+
 stacking_list_t *
 make_stack(node_t *n)
 {
-    stacking_list_t *s = calloc(1, sizeof(stacking_list_t));
+    stacking_list_t *s = pool_alloc(&stack_pool);
 
     s->node = n;
+    s->level = stack_level(n->client);
     s->prev = s->next = NULL;
 
     return s;
 }
 
-void
-stack_insert_after(stacking_list_t *a, node_t *n)
+/* The entry right below where the given level starts. */
+static stacking_list_t *
+level_floor(int level)
 {
-    stacking_list_t *s = make_stack(n);
-
-    if (a == NULL) {
-        stack_head = stack_tail = s;
-    } else {
-        if (a->node == n) {
-            free(s);
-
-            return;
-        }
-
-        remove_stack_node(n);
-        stacking_list_t *b = a->next;
-
-        if (b != NULL)
-            b->prev = s;
-
-        s->next = b;
-        s->prev = a;
-        a->next = s;
-
-        if (stack_tail == a)
-            stack_tail = s;
+    for (int i = level - 1; i >= 0; i--) {
+        if (level_tail[i] != NULL)
+            return level_tail[i];
     }
+
+    return NULL;
 }
 
-void
-stack_insert_before(stacking_list_t *a, node_t *n)
+/* Link `s` right above `a`, or at the very bottom if `a` is NULL. */
+static void
+stack_link(stacking_list_t *s, stacking_list_t *a)
 {
-    stacking_list_t *s = make_stack(n);
-
-    if (a == NULL) {
-        stack_head = stack_tail = s;
-    } else {
-        if (a->node == n) {
-            free(s);
-
-            return;
-        }
+    stacking_list_t *b = (a != NULL ? a->next : stack_head);
+    int l = s->level;
 
-        remove_stack_node(n);
-        stacking_list_t *b = a->prev;
+    s->prev = a;
+    s->next = b;
 
-        if (b != NULL)
-            b->next = s;
-
-        s->prev = b;
-        s->next = a;
-        s->prev = s;
+    if (a != NULL)
+        a->next = s;
+    else
+        stack_head = s;
 
-        if (stack_head == a)
-            stack_head = s;
+    if (b != NULL)
+        b->prev = s;
+    else
+        stack_tail = s;
+
+    if (level_head[l] == NULL) {
+        level_head[l] = level_tail[l] = s;
+    } else if (a == level_tail[l]) {
+        level_tail[l] = s;
+    } else if (b == level_head[l]) {
+        level_head[l] = s;
     }
+
+    s->node->stack = s;
 }
 
-void
-remove_stack(stacking_list_t *s)
+static void
+stack_unlink(stacking_list_t *s)
 {
-    if (s == NULL)
-        return;
-
     stacking_list_t *a = s->prev;
     stacking_list_t *b = s->next;
+    int l = s->level;
+
+    if (level_head[l] == s && level_tail[l] == s) {
+        level_head[l] = level_tail[l] = NULL;
+    } else if (level_head[l] == s) {
+        level_head[l] = b;
+    } else if (level_tail[l] == s) {
+        level_tail[l] = a;
+    }
 
     if (a != NULL)
         a->next = b;
@@ -103,22 +109,60 @@ remove_stack(stacking_list_t *s)
     if (s == stack_tail)
         stack_tail = a;
 
-    free(s);
+    s->prev = s->next = NULL;
+}
+
+/**
+ * Move a node to the top or the bottom of its level, and tell whether it
+ * had to move at all. Nodes entering the list, or coming from another
+ * level, always do.
+**/
+bool
+stack_insert(node_t *n, bool top)
+{
+    stacking_list_t *s = n->stack;
+    int l = stack_level(n->client);
+
+    if (s != NULL && s->level == l && s == (top ? level_tail[l] : level_head[l]))
+        return false;
+
+    if (s == NULL)
+        s = make_stack(n);
+    else
+        stack_unlink(s);
+
+    s->level = l;
+
+    if (level_head[l] == NULL)
+        stack_link(s, level_floor(l));
+    else
+        stack_link(s, top ? level_tail[l] : level_head[l]->prev);
+
+    return true;
+}
+
+void
+remove_stack(stacking_list_t *s)
+{
+    if (s == NULL)
+        return;
+
+    stack_unlink(s);
+
+    if (s->node->stack == s)
+        s->node->stack = NULL;
+
+    pool_free(&stack_pool, s);
 }
 
 void
 remove_stack_node(node_t *n)
 {
     node_t *f;
-    stacking_list_t *s;
 
     for (*f = first_extrema(n); f != NULL; f = next_leaf(f, n)) {
-        for (*s = stack_head; s != NULL; s = s->next) {
-            if (s->node == f) {
-                remove_stack(s);
-                break;
-            }
-        }
+        if (f->stack != NULL)
+            remove_stack(f->stack);
     }
 }
 
@@ -137,73 +181,42 @@ stack_cmp(client_t *c1, client_t *c2)
     return stack_level(c1) - stack_level(c2);
 }
 
-stacking_list_t *
-limit_above(node_t *n)
-{
-    stacking_list_t *s = stack_head;
-
-    while (s != NULL && stack_cmp(n->client, s->node->client) >= 0)
-        s = s->next;
-
-    if (s == NULL)
-        s = stack_tail;
-
-    if (s->node == n)
-        s = s->prev;
-
-    return s;
-}
-
-stacking_list_t *
-limit_below(node_t *n)
-{
-    stacking_list_t *s = stack_tail;
-
-    while (s != NULL && stack_cmp(n->client, s->node->client) <= 0)
-        s = s->prev;
-
-    if (s == NULL)
-        s = stack_head;
-
-    if (s->node == n)
-        s = s->next;
-
-    return s;
-}
-
+/**
+ * Only the windows that actually change places are restacked, each one
+ * against its new neighbour, and the stacking hint is only updated when
+ * something moved: raising the window that is already on top of its
+ * level costs nothing.
+**/
 void
 stack(desktop_t *d, node_t *n, bool focused)
 {
     node_t *f;
+    bool moved = false;
 
     for (*f = first_extrema(n); f != NULL; f = next_leaf(f, n)) {
         if (f->client == NULL || (IS_FLOATING(f->client) && !auto_raise))
             continue;
 
-        if (stack_head == NULL) {
-            stack_insert_after(NULL, f);
-        } else {
-            stacking_list_t *s = (focused ? limit_above(f) : limit_below(f));
-
-            if (s == NULL)
-                continue;
-
-            int i = stack_cmp(f->client, s->node->client);
-
-            if (i < 0 || (i == 0 && !focused)) {
-                stack_insert_before(s, f);
-                window_below(f->id, s->node->id);
-                put_status(SBSC_MASK_NODE_STACK, "node_stack 0x%08X below 0x%08X\n",
-                    f->id, s->node->id);
-            } else {
-                stack_insert_after(s, f);
-                window_above(f->id, s->node->id);
-                put_status(SBSC_MASK_NODE_STACK, "node_stack 0x%08X above 0x%08X",
-                    f->id, s->node->id);
-            }
+        if (!stack_insert(f, focused))
+            continue;
+
+        stacking_list_t *s = f->stack;
+        moved = true;
+
+        if (s->prev != NULL) {
+            window_above(f->id, s->prev->node->id);
+            put_status(SBSC_MASK_NODE_STACK, "node_stack 0x%08X above 0x%08X\n",
+                f->id, s->prev->node->id);
+        } else if (s->next != NULL) {
+            window_below(f->id, s->next->node->id);
+            put_status(SBSC_MASK_NODE_STACK, "node_stack 0x%08X below 0x%08X\n",
+                f->id, s->next->node->id);
         }
     }
 
+    if (!moved)
+        return;
+
     ewmh_update_client_list(true);
     restack_presel_feedbacks(d);
 }
@@ -6,30 +6,395 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <ctype.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <errno.h>
 #include <stdarg.h>
+#include <inttypes.h>
 
 #include "lowm.h"
+#include "batch.h"
+#include "delta.h"
 #include "desktop.h"
+#include "journal.h"
+#include "loop.h"
 #include "settings.h"
+#include "snapshot.h"
 #include "subscribe.h"
 #include "tree.h"
 
 subscriber_list_t *
-make_subscriber(FILE *stream, char **fifo_path, int field, int count)
+make_subscriber(int fd, char *fifo_path, int field, int count, subscriber_policy_t policy)
 {
-    subscribe_list_t *sb = calloc(1, sizeof(subscribe_list_t));
+    subscriber_list_t *sb = calloc(1, sizeof(subscriber_list_t));
+
+    if (sb == NULL) {
+        perror("subscribe: calloc");
+
+        return NULL;
+    }
 
     sb->prev = sb->next = NULL;
-    sb->stream = stream;
+    sb->fd = fd;
     sb->fifo_path = fifo_path;
+    sb->fifo_shared = (fifo_path != NULL);
+    sb->fifo_written = 0;
+    sb->stalled_since = 0;
     sb->field = field;
     sb->count = count;
+    sb->policy = policy;
+    sb->queue = NULL;
+    sb->queue_cap = sb->queue_head = sb->queue_len = 0;
+    sb->pending = sb->sent = 0;
+    sb->done = false;
+    sb->monitor_id = sb->desktop_id = sb->node_id = 0;
+    sb->seq = sb->resume = false;
+    sb->resume_from = sb->replay_next = 0;
+    sb->throttle_rules = NULL;
+    sb->throttle_field = 0;
+    sb->throttle_buckets = sb->throttle_heap = NULL;
+    sb->throttle_cap = sb->throttle_len = 0;
+    sb->source = NULL;
 
     return sb;
 }
 
+throttle_rule_t *
+make_throttle_rule(int field, uint32_t interval)
+{
+    throttle_rule_t *tr = calloc(1, sizeof(throttle_rule_t));
+
+    if (tr == NULL) {
+        perror("subscribe: calloc");
+
+        return NULL;
+    }
+
+    tr->field = field;
+    tr->interval = interval;
+    tr->next = NULL;
+
+    return tr;
+}
+
+/**
+ * The last report sent, and whether one is due at the end of the loop
+ * iteration. Reports identical to the last one aren't sent again.
+**/
+static subscriber_message_t *last_report = NULL;
+static bool report_due = false;
+
+static subscriber_message_t *
+make_message(char *data, size_t len)
+{
+    subscriber_message_t *msg = malloc(sizeof(subscriber_message_t));
+
+    if (msg == NULL) {
+        perror("subscribe: malloc");
+        free(data);
+
+        return NULL;
+    }
+
+    msg->refs = 1;
+    msg->data = data;
+    msg->len = len;
+
+    return msg;
+}
+
+static void
+unref_message(subscriber_message_t *msg)
+{
+    if (msg == NULL || --msg->refs > 0)
+        return;
+
+    free(msg->data);
+    free(msg);
+}
+
+static inline subscriber_entry_t *
+queue_at(subscriber_list_t *sb, size_t i)
+{
+    return &sb->queue[(sb->queue_head + i) % sb->queue_cap];
+}
+
+/* Remove the i-th queued message, moving whichever side of the ring is shorter. */
+static void
+queue_drop(subscriber_list_t *sb, size_t i)
+{
+    subscriber_entry_t *e = queue_at(sb, i);
+
+    sb->pending -= e->msg->len;
+    unref_message(e->msg);
+
+    if (i < sb->queue_len / 2) {
+        for (size_t j = i; j > 0; j--)
+            *queue_at(sb, j) = *queue_at(sb, j - 1);
+
+        sb->queue_head = (sb->queue_head + 1) % sb->queue_cap;
+    } else {
+        for (size_t j = i; j + 1 < sb->queue_len; j++)
+            *queue_at(sb, j) = *queue_at(sb, j + 1);
+    }
+
+    sb->queue_len--;
+}
+
+static bool
+queue_grow(subscriber_list_t *sb)
+{
+    size_t cap = (sb->queue_cap == 0 ? SUBSCRIBER_INIT_QUEUE : 2 * sb->queue_cap);
+    subscriber_entry_t *queue = calloc(cap, sizeof(subscriber_entry_t));
+
+    if (queue == NULL) {
+        perror("subscribe: calloc");
+
+        return false;
+    }
+
+    for (size_t i = 0; i < sb->queue_len; i++)
+        queue[i] = *queue_at(sb, i);
+
+    free(sb->queue);
+    sb->queue = queue;
+    sb->queue_cap = cap;
+    sb->queue_head = 0;
+
+    return true;
+}
+
+/**
+ * Make room for len more bytes according to the policy of the subscriber.
+ * The message being written is never dropped, that would cut it in half.
+**/
+static bool
+queue_make_room(subscriber_list_t *sb, int mask, size_t len)
+{
+    size_t first = (sb->sent > 0 ? 1 : 0);
+
+    if (sb->pending + len <= SUBSCRIBER_MAX_PENDING)
+        return true;
+
+    if (sb->policy == SBSC_POLICY_DISCONNECT)
+        return false;
+
+    /* Older messages of the same kind are superseded by the new one. */
+    if (sb->policy == SBSC_POLICY_COALESCE) {
+        for (size_t i = first; i < sb->queue_len && sb->pending + len > SUBSCRIBER_MAX_PENDING;) {
+            if (queue_at(sb, i)->mask == mask)
+                queue_drop(sb, i);
+            else
+                i++;
+        }
+    }
+
+    while (sb->queue_len > first && sb->pending + len > SUBSCRIBER_MAX_PENDING)
+        queue_drop(sb, first);
+
+    return true;
+}
+
+static bool
+queue_message(subscriber_list_t *sb, int mask, subscriber_message_t *msg)
+{
+    if (!queue_make_room(sb, mask, msg->len))
+        return false;
+
+    if (sb->queue_len == sb->queue_cap && !queue_grow(sb))
+        return false;
+
+    msg->refs++;
+    *queue_at(sb, sb->queue_len++) = (subscriber_entry_t) { mask, msg };
+    sb->pending += msg->len;
+
+    return true;
+}
+
+static bool replay_subscriber(subscriber_list_t *sb);
+
+/**
+ * A FIFO is first opened for reading and writing, so that opening it
+ * doesn't wait for a reader. As long as we hold its reading end, a reader
+ * going away goes unnoticed, so it's traded for a writing end alone once
+ * a reader is known to be there. What's in the FIFO stays.
+**/
+static void
+fifo_reopen(subscriber_list_t *sb)
+{
+    int fd = open(sb->fifo_path, O_WRONLY | O_NONBLOCK);
+
+    if (fd == -1)
+        return;
+
+    event_source_t *src = loop_add(fd, 0, handle_subscriber, sb);
+
+    if (src == NULL) {
+        close(fd);
+
+        return;
+    }
+
+    loop_remove(sb->source);
+    close(sb->fd);
+    sb->fd = fd;
+    sb->source = src;
+    sb->fifo_shared = false;
+}
+
+/**
+ * Our own reading end makes any open succeed, so the only proof of a
+ * reader is that some of what we wrote left the FIFO. Returns false when
+ * nobody has read anything SUBSCRIBER_FIFO_TIMEOUT milliseconds after we
+ * first found it waiting.
+**/
+static bool
+fifo_check(subscriber_list_t *sb)
+{
+    int queued;
+
+    if (sb->fifo_written == 0 || ioctl(sb->fd, FIONREAD, &queued) == -1)
+        return true;
+
+    if ((size_t) queued < sb->fifo_written) {
+        fifo_reopen(sb);
+
+        return true;
+    }
+
+    uint64_t now = monotonic_ms();
+
+    if (sb->stalled_since == 0)
+        sb->stalled_since = now;
+    else if (now - sb->stalled_since > SUBSCRIBER_FIFO_TIMEOUT)
+        return false;
+
+    return true;
+}
+
+/**
+ * Write as much as the descriptor takes without blocking and wait for it
+ * to be writable again for the rest, refilling the queue from the journal
+ * while the subscriber catches up. Returns false once the subscriber
+ * should be removed.
+**/
+static bool
+flush_subscriber(subscriber_list_t *sb)
+{
+    if (sb->fifo_shared && !fifo_check(sb))
+        return false;
+
+    for (;;) {
+        if (sb->replay_next != 0 && sb->pending <= SUBSCRIBER_MAX_PENDING / 2 &&
+            !replay_subscriber(sb))
+                return false;
+
+        if (sb->queue_len == 0)
+            break;
+
+        struct iovec iov[SUBSCRIBER_MAX_IOV];
+        int cnt = 0;
+
+        for (size_t i = 0; i < sb->queue_len && cnt < SUBSCRIBER_MAX_IOV; i++, cnt++) {
+            subscriber_message_t *msg = queue_at(sb, i)->msg;
+            size_t skip = (i == 0 ? sb->sent : 0);
+
+            iov[cnt].iov_base = msg->data + skip;
+            iov[cnt].iov_len = msg->len - skip;
+        }
+
+        ssize_t n = writev(sb->fd, iov, cnt);
+
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                loop_modify(sb->source, EPOLLOUT);
+
+                return true;
+            }
+
+            return false;
+        }
+
+        if (sb->fifo_shared)
+            sb->fifo_written += n;
+
+        /* Drop what went through and remember how much of the next one did. */
+        size_t left = n;
+
+        while (left > 0) {
+            size_t rest = queue_at(sb, 0)->msg->len - sb->sent;
+
+            if (left < rest) {
+                sb->sent += left;
+                break;
+            }
+
+            left -= rest;
+            sb->sent = 0;
+            queue_drop(sb, 0);
+        }
+    }
+
+    loop_modify(sb->source, 0);
+
+    return !sb->done;
+}
+
+static void
+count_message(subscriber_list_t *sb)
+{
+    if (sb->count > 0 && --sb->count == 0)
+        sb->done = true;
+}
+
+/* Queue a message and try to send it right away. */
+static bool
+notify_subscriber(subscriber_list_t *sb, int mask, subscriber_message_t *msg)
+{
+    count_message(sb);
+
+    return (queue_message(sb, mask, msg) && flush_subscriber(sb));
+}
+
+/* The same event, preceded by its sequence number. */
+static subscriber_message_t *
+make_seq_message(uint64_t seq, char *data, size_t len)
+{
+    char *buf;
+    int n = asprintf(&buf, "%" PRIu64 " %.*s", seq, (int) len, data);
+
+    if (n == -1)
+        return NULL;
+
+    return make_message(buf, n);
+}
+
+static subscriber_message_t *
+make_report(void)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *stream = open_memstream(&buf, &len);
+
+    if (stream == NULL) {
+        perror("subscribe: open_memstream");
+
+        return NULL;
+    }
+
+    print_report(stream);
+    fclose(stream);
+
+    return make_message(buf, len);
+}
+
 void
 remove_subscriber(subscriber_list_t *sb)
 {
@@ -51,11 +416,32 @@ remove_subscriber(subscriber_list_t *sb)
     if (sb == subscribe_tail)
         subscribe_tail = a;
 
+    loop_remove(sb->source);
+
     if (!restart) {
-        fclose(sb->stream);
-        unlink(sb->fifo_path);
+        close(sb->fd);
+
+        if (sb->fifo_path != NULL)
+            unlink(sb->fifo_path);
+    }
+
+    while (sb->queue_len > 0)
+        queue_drop(sb, 0);
+
+    while (sb->throttle_rules != NULL) {
+        throttle_rule_t *next = sb->throttle_rules->next;
+        free(sb->throttle_rules);
+        sb->throttle_rules = next;
+    }
+
+    for (size_t i = 0; i < sb->throttle_len; i++) {
+        unref_message(sb->throttle_heap[i]->held);
+        free(sb->throttle_heap[i]);
     }
 
+    free(sb->throttle_heap);
+    free(sb->throttle_buckets);
+    free(sb->queue);
     free(sb->fifo_path);
     free(sb);
 }
@@ -71,11 +457,33 @@ add_subscriber(subscriber_list_t *sb)
         subscribe_tail = sb;
     }
 
+    for (throttle_rule_t *tr = sb->throttle_rules; tr != NULL; tr = tr->next)
+        sb->throttle_field |= tr->field;
+
+    /* Errors and hang-ups are always reported, we only ask for writability when needed. */
+    sb->source = loop_add(sb->fd, 0, handle_subscriber, sb);
+
+    /* Catch up on the events that followed the last one it saw, the report comes after. */
+    if (sb->resume) {
+        sb->replay_next = sb->resume_from + 1;
+
+        if (!flush_subscriber(sb))
+            remove_subscriber(sb);
+
+        return;
+    }
+
     if (sb->field & SBSC_MASK_REPORT) {
-        print_report(sb->stream);
+        subscriber_message_t *report = make_report();
+        bool sent = (report != NULL && notify_subscriber(sb, SBSC_MASK_REPORT, report));
 
-        if (sb->count-- == 1)
+        unref_message(report);
+
+        if (!sent) {
             remove_subscriber(sb);
+
+            return;
+        }
     }
 }
 
@@ -136,55 +544,493 @@ print_report(FILE *stream)
     return fflush(stream);
 }
 
+/**
+ * The monitor, desktop and node an event is about: the leading arguments
+ * of its message are their ids, in that order.
+**/
+typedef struct {
+    int depth;
+    uint32_t ids[3];
+} status_scope_t;
+
+static status_scope_t
+read_scope(subscriber_mask_t mask, va_list args)
+{
+    status_scope_t scope = { 0, { 0, 0, 0 } };
+
+    if (mask & SBSC_MASK_MONITOR)
+        scope.depth = 1;
+    else if (mask & SBSC_MASK_DESKTOP)
+        scope.depth = 2;
+    else if (mask != SBSC_MASK_NODE_STACK && (mask & SBSC_MASK_NODE))
+        scope.depth = 3;
+
+    for (int i = 0; i < scope.depth; i++)
+        scope.ids[i] = va_arg(args, unsigned int);
+
+    /* The third argument of node_add is the node it was inserted next to. */
+    if (mask == SBSC_MASK_NODE_ADD)
+        scope.ids[2] = va_arg(args, unsigned int);
+
+    return scope;
+}
+
+static bool
+in_scope(subscriber_list_t *sb, subscriber_mask_t mask, status_scope_t *scope)
+{
+    uint32_t filter[] = { sb->monitor_id, sb->desktop_id, sb->node_id };
+
+    /* There's only one report, for everything. */
+    if (mask == SBSC_MASK_REPORT)
+        return true;
+
+    for (int i = 0; i < 3; i++) {
+        if (filter[i] != 0 && (i >= scope->depth || scope->ids[i] != filter[i]))
+            return false;
+    }
+
+    return true;
+}
+
+static uint32_t
+throttle_hash(int mask, uint32_t key)
+{
+    return (key * 2654435761u) ^ (uint32_t) mask;
+}
+
+static void
+throttle_swap(throttle_entry_t **heap, size_t i, size_t j)
+{
+    throttle_entry_t *te = heap[i];
+
+    heap[i] = heap[j];
+    heap[j] = te;
+    heap[i]->heap_pos = i;
+    heap[j]->heap_pos = j;
+}
+
+/* Move an entry whose deadline changed back to its place in the heap. */
+static void
+throttle_sift(subscriber_list_t *sb, size_t i)
+{
+    throttle_entry_t **heap = sb->throttle_heap;
+
+    while (i > 0 && heap[i]->deadline < heap[(i - 1) / 2]->deadline) {
+        throttle_swap(heap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+
+    for (;;) {
+        size_t min = i;
+        size_t l = 2 * i + 1;
+        size_t r = l + 1;
+
+        if (l < sb->throttle_len && heap[l]->deadline < heap[min]->deadline)
+            min = l;
+
+        if (r < sb->throttle_len && heap[r]->deadline < heap[min]->deadline)
+            min = r;
+
+        if (min == i)
+            break;
+
+        throttle_swap(heap, i, min);
+        i = min;
+    }
+}
+
+/* The heap and the buckets grow together, there are as many buckets as entries fit. */
+static bool
+throttle_grow(subscriber_list_t *sb)
+{
+    size_t cap = (sb->throttle_cap == 0 ? THROTTLE_INIT_CAP : sb->throttle_cap * 2);
+    throttle_entry_t **heap = realloc(sb->throttle_heap, cap * sizeof(throttle_entry_t *));
+
+    if (heap == NULL) {
+        perror("subscribe: realloc");
+
+        return false;
+    }
+
+    sb->throttle_heap = heap;
+    throttle_entry_t **buckets = calloc(cap, sizeof(throttle_entry_t *));
+
+    if (buckets == NULL) {
+        perror("subscribe: calloc");
+
+        return false;
+    }
+
+    free(sb->throttle_buckets);
+    sb->throttle_buckets = buckets;
+    sb->throttle_cap = cap;
+
+    for (size_t i = 0; i < sb->throttle_len; i++) {
+        throttle_entry_t **slot = &buckets[throttle_hash(heap[i]->mask, heap[i]->key) & (cap - 1)];
+        heap[i]->next = *slot;
+        *slot = heap[i];
+    }
+
+    return true;
+}
+
+static throttle_entry_t *
+find_throttle_entry(subscriber_list_t *sb, int mask, uint32_t key)
+{
+    if (sb->throttle_cap == 0)
+        return NULL;
+
+    throttle_entry_t *te = sb->throttle_buckets[throttle_hash(mask, key) & (sb->throttle_cap - 1)];
+
+    while (te != NULL && (te->mask != mask || te->key != key))
+        te = te->next;
+
+    return te;
+}
+
+/* Forget about the entry with the earliest deadline. */
+static void
+throttle_pop(subscriber_list_t *sb)
+{
+    throttle_entry_t *te = sb->throttle_heap[0];
+    throttle_entry_t **slot = &sb->throttle_buckets[throttle_hash(te->mask, te->key) &
+        (sb->throttle_cap - 1)];
+
+    while (*slot != te)
+        slot = &(*slot)->next;
+
+    *slot = te->next;
+    sb->throttle_len--;
+
+    if (sb->throttle_len > 0) {
+        sb->throttle_heap[0] = sb->throttle_heap[sb->throttle_len];
+        sb->throttle_heap[0]->heap_pos = 0;
+        throttle_sift(sb, 0);
+    }
+
+    free(te);
+}
+
+/**
+ * Tell whether a message can be sent right away. If not, it replaces the
+ * one held back for the same kind of event on the same object, and will
+ * be sent by subscribe_expire() once the interval is over.
+**/
+static bool
+throttle_message(subscriber_list_t *sb, int mask, uint32_t key, subscriber_message_t *msg)
+{
+    if (!(sb->throttle_field & mask))
+        return true;
+
+    uint64_t now = monotonic_ms();
+    throttle_entry_t *te = find_throttle_entry(sb, mask, key);
+
+    if (te == NULL) {
+        throttle_rule_t *tr = sb->throttle_rules;
+
+        while (!(tr->field & mask))
+            tr = tr->next;
+
+        if (sb->throttle_len == sb->throttle_cap && !throttle_grow(sb))
+            return true;
+
+        if ((te = calloc(1, sizeof(throttle_entry_t))) == NULL) {
+            perror("subscribe: calloc");
+
+            return true;
+        }
+
+        throttle_entry_t **slot = &sb->throttle_buckets[throttle_hash(mask, key) &
+            (sb->throttle_cap - 1)];
+
+        te->mask = mask;
+        te->key = key;
+        te->interval = tr->interval;
+        te->deadline = now + tr->interval;
+        te->held = NULL;
+        te->next = *slot;
+        *slot = te;
+        te->heap_pos = sb->throttle_len;
+        sb->throttle_heap[sb->throttle_len++] = te;
+        throttle_sift(sb, te->heap_pos);
+
+        return true;
+    }
+
+    if (te->held == NULL && now >= te->deadline) {
+        te->deadline = now + te->interval;
+        throttle_sift(sb, te->heap_pos);
+
+        return true;
+    }
+
+    unref_message(te->held);
+    msg->refs++;
+    te->held = msg;
+
+    return false;
+}
+
+typedef struct {
+    subscriber_list_t *sb;
+    bool failed;
+} replay_state_t;
+
+/**
+ * Replayed events go through the same filters as live ones, except for
+ * throttling: the subscriber asked for everything it missed. The replay
+ * stops whenever the queue is full, and picks up at the same event once
+ * the descriptor has drained.
+**/
+static bool
+replay_event(uint64_t seq, int mask, uint32_t *ids, int depth, char *data, size_t len,
+    void *arg)
+{
+    replay_state_t *rs = arg;
+    subscriber_list_t *sb = rs->sb;
+    status_scope_t scope = { depth, { ids[0], ids[1], ids[2] } };
+
+    if (sb->done)
+        return false;
+
+    if ((sb->field & mask) && in_scope(sb, mask, &scope)) {
+        subscriber_message_t *msg = make_seq_message(seq, data, len);
+
+        if (msg == NULL) {
+            rs->failed = true;
+
+            return false;
+        }
+
+        if (sb->queue_len > 0 && sb->pending + msg->len > SUBSCRIBER_MAX_PENDING) {
+            unref_message(msg);
+
+            return false;
+        }
+
+        bool queued = queue_message(sb, mask, msg);
+
+        unref_message(msg);
+
+        if (!queued) {
+            rs->failed = true;
+
+            return false;
+        }
+
+        count_message(sb);
+    }
+
+    sb->replay_next = seq + 1;
+
+    return true;
+}
+
+/**
+ * Queue as much of what the subscriber missed as fits. Live events and
+ * reports are held back until it has caught up with the journal, and the
+ * report it asked for is the first thing it gets then.
+**/
+static bool
+replay_subscriber(subscriber_list_t *sb)
+{
+    replay_state_t rs = { sb, false };
+
+    if (!journal_replay(sb->replay_next - 1, replay_event, &rs) || rs.failed)
+        return false;
+
+    if (sb->replay_next < journal_next_seq() && !sb->done)
+        return true;
+
+    sb->replay_next = 0;
+
+    if (!(sb->field & SBSC_MASK_REPORT) || sb->done)
+        return true;
+
+    subscriber_message_t *report = make_report();
+    bool queued = (report != NULL && queue_message(sb, SBSC_MASK_REPORT, report));
+
+    unref_message(report);
+
+    if (queued)
+        count_message(sb);
+
+    return queued;
+}
+
+/**
+ * Reports are only built once per loop iteration, by flush_report(), no
+ * matter how many changes asked for one.
+**/
 void
 put_status(subscriber_mask_t mask, ...)
 {
-    subscriber_list_t *next = sb->next;
+    if (mask == SBSC_MASK_REPORT) {
+        if (!batch_defer(BATCH_REPORT))
+            report_due = true;
 
-    while (sb != NULL) {
-        if (sb->field & mask) {
-            if (sb->count > 0)
-                sb->count--;
-
-            if (mask == SBSC_MASK_REPORT) {
-                ret = print_report(sb->stream);
-            } else {
-                char *fmt;
-                va_list args;
-
-                va_start(args, mask);
-                fmt = va_arg(args, char *);
-                vfprintf(sb->stream, fmt, args);
-                va_end(args);
-                ret = fflush(sb->stream);
-            }
+        return;
+    }
+
+    va_list args, ids;
+    char *fmt;
+
+    va_start(args, mask);
+    fmt = va_arg(args, char *);
+    va_copy(ids, args);
+    status_scope_t scope = read_scope(mask, ids);
+    va_end(ids);
+    touch_event(mask, scope.ids, scope.depth);
+
+    uint32_t key = (scope.depth > 0 ? scope.ids[scope.depth - 1] : 0);
 
-            if (ret != 0 || sb->count == 0)
+    /**
+     * Formatted once, journaled and shared by every subscriber, along with
+     * a numbered copy for those that asked for sequence numbers.
+    **/
+    char *data;
+    int n = vasprintf(&data, fmt, args);
+
+    va_end(args);
+
+    if (n == -1)
+        return;
+
+    uint64_t seq = journal_append(mask, scope.ids, scope.depth, data, n);
+    subscriber_message_t *msg = make_message(data, n);
+    subscriber_message_t *seq_msg = NULL;
+    subscriber_list_t *sb = subscribe_head;
+
+    while (sb != NULL && msg != NULL) {
+        subscriber_list_t *next = sb->next;
+
+        if ((sb->field & mask) && !sb->done && sb->replay_next == 0 &&
+            in_scope(sb, mask, &scope)) {
+            if (sb->seq && seq_msg == NULL &&
+                (seq_msg = make_seq_message(seq, msg->data, msg->len)) == NULL)
+                break;
+
+            subscriber_message_t *m = (sb->seq ? seq_msg : msg);
+
+            if (throttle_message(sb, mask, key, m) && !notify_subscriber(sb, mask, m))
                 remove_subscriber(sb);
         }
 
         sb = next;
     }
+
+    unref_message(msg);
+    unref_message(seq_msg);
+}
+
+int
+subscribe_timeout(void)
+{
+    int64_t timeout = -1;
+    uint64_t now = monotonic_ms();
+
+    /* Entries holding nothing are due as well, to be forgotten. */
+    for (subscriber_list_t *sb = subscribe_head; sb != NULL; sb = sb->next) {
+        if (sb->throttle_len == 0)
+            continue;
+
+        uint64_t deadline = sb->throttle_heap[0]->deadline;
+        int64_t delay = (deadline <= now ? 0 : (int64_t) (deadline - now));
+
+        if (timeout == -1 || delay < timeout)
+            timeout = delay;
+    }
+
+    return (int) timeout;
 }
 
 void
-prune_dead_subscribers(void)
+subscribe_expire(void)
 {
+    uint64_t now = monotonic_ms();
     subscriber_list_t *sb = subscribe_head;
 
     while (sb != NULL) {
         subscriber_list_t *next = sb->next;
+        bool gone = false;
+
+        while (sb->throttle_len > 0 && !gone && sb->throttle_heap[0]->deadline <= now) {
+            throttle_entry_t *te = sb->throttle_heap[0];
 
-        /**
-         * To check if a subscriber's stream is still open and writable
-         * call write with an empty buffer and check the returned value.
-         * If the stream is not writeable anymore (i.e. it has been
-         * closed because the process associated to this subscriber no
-         * longer exists) then write() will return -1.
-        **/
-        if (write(fileno(sb->stream), 0, 0) == -1)
+            /* Nothing happened during the interval, forget about this object. */
+            if (te->held == NULL) {
+                throttle_pop(sb);
+                continue;
+            }
+
+            subscriber_message_t *msg = te->held;
+            te->held = NULL;
+            te->deadline = now + te->interval;
+            throttle_sift(sb, 0);
+            gone = (!sb->done && !notify_subscriber(sb, te->mask, msg));
+            unref_message(msg);
+        }
+
+        if (gone)
             remove_subscriber(sb);
 
         sb = next;
     }
 }
+
+void
+flush_report(void)
+{
+    if (!report_due)
+        return;
+
+    report_due = false;
+    snapshot_update();
+    subscriber_list_t *sb;
+
+    for (sb = subscribe_head; sb != NULL; sb = sb->next) {
+        if ((sb->field & SBSC_MASK_REPORT) && !sb->done && sb->replay_next == 0)
+            break;
+    }
+
+    if (sb == NULL) {
+        unref_message(last_report);
+        last_report = NULL;
+
+        return;
+    }
+
+    subscriber_message_t *report = make_report();
+
+    if (report == NULL)
+        return;
+
+    if (last_report != NULL && last_report->len == report->len &&
+        memcmp(last_report->data, report->data, report->len) == 0) {
+        unref_message(report);
+
+        return;
+    }
+
+    unref_message(last_report);
+    last_report = report;
+
+    while (sb != NULL) {
+        subscriber_list_t *next = sb->next;
+
+        if ((sb->field & SBSC_MASK_REPORT) && !sb->done && sb->replay_next == 0 &&
+            !notify_subscriber(sb, SBSC_MASK_REPORT, report))
+                remove_subscriber(sb);
+
+        sb = next;
+    }
+}
+
+void
+handle_subscriber(event_source_t *src, uint32_t events)
+{
+    subscriber_list_t *sb = src->data;
+
+    if ((events & (EPOLLERR | EPOLLHUP)) || ((events & EPOLLOUT) && !flush_subscriber(sb)))
+        remove_subscriber(sb);
+}
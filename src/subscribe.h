@@ -10,6 +10,11 @@
 #define LOWM_SUBSCRIBE_H
 
 #define FIFO_TEMPLATE "lowm_fifo.XXXXXX"
+#define SUBSCRIBER_INIT_QUEUE 16
+#define SUBSCRIBER_MAX_PENDING (1 << 16)
+#define SUBSCRIBER_MAX_IOV 64
+#define SUBSCRIBER_FIFO_TIMEOUT 10000
+#define THROTTLE_INIT_CAP 16
 
 typedef enum {
 	SBSC_MASK_REPORT = 1 << 0,
@@ -46,16 +51,26 @@ typedef enum {
 	SBSC_MASK_ALL = (1 << 28) - 1,
 } subscriber_mask_t;
 
-subscriber_list_t *make_subscriber(FILE *stream, char *fifo_path, int field, int count);
+subscriber_list_t *make_subscriber(int fd, char *fifo_path, int field, int count,
+    subscriber_policy_t policy);
+throttle_rule_t *make_throttle_rule(int field, uint32_t interval);
 void remove_subscriber(subscriber_list_t *sb);
 void add_subscriber(subscriber_list_t *sb);
 int print_report(FILE *stream);
 void put_status(subscriber_mask_t mask, ...);
+void flush_report(void);
 
 /**
- * Remove any subscriber for which the stream has been closed an
- * is no longer writable.
+ * When the next event held back by a throttle rule is due, and sending
+ * those that are.
 **/
-void prune_dead_subscribers(void);
+int subscribe_timeout(void);
+void subscribe_expire(void);
+
+/**
+ * Send what's left of the queue once the descriptor is writable again,
+ * or remove the subscriber once its reader went away.
+**/
+void handle_subscriber(event_source_t *src, uint32_t events);
 
 #endif
@@ -9,25 +9,74 @@
 #include <limits.h>
 
 #include "lowm.h"
+#include "batch.h"
+#include "delta.h"
 #include "desktop.h"
 #include "ewmh.h"
 #include "history.h"
+#include "index.h"
 #include "monitor.h"
 #include "query.h"
 #include "geometry.h"
 #include "subscribe.h"
 #include "settings.h"
 #include "pointer.h"
+#include "intern.h"
+#include "pool.h"
 #include "stack.h"
 #include "window.h"
 #include "tree.h"
 
+static unsigned int dirty_desktops = 0;
+
+/* Bumped by every invalidation, settled geometry from before it is stale. */
+static uint64_t layout_epoch = 1;
+
+static pool_t node_pool = POOL_INIT(node_t);
+static pool_t client_pool = POOL_INIT(client_t);
+static pool_t client_info_pool = POOL_INIT(client_info_t);
+static pool_t presel_pool = POOL_INIT(presel_t);
+
+/**
+ * Arranging a desktop only marks it dirty: the dirty desktops are laid
+ * out once, by arrange_dirty(), right before the event loop goes back to
+ * sleep.
+**/
 void
 arrange(monitor_t *m, desktop_t *d)
 {
-    if (d->root == NULL)
+    if (d == NULL)
+        return;
+
+    d->settled = 0;
+
+    if (d->dirty || batch_hold(d))
+        return;
+
+    d->dirty = true;
+    dirty_desktops++;
+}
+
+void
+arrange_dirty(void)
+{
+    if (dirty_desktops == 0)
         return;
 
+    for (monitor_t *m = mon_head; m != NULL; m = m->next) {
+        for (desktop_t *d = m->desk_head; d != NULL; d = d->next) {
+            if (d->dirty)
+                arrange_now(m, d);
+        }
+    }
+
+    /* Along with the desktops removed while dirty. */
+    dirty_desktops = 0;
+}
+
+static xcb_rectangle_t
+desktop_rectangle(monitor_t *m, desktop_t *d)
+{
     xcb_rectangle_t rect = m->rectangle;
 
     rect.x += m->padding.left + d->padding.left;
@@ -49,15 +98,198 @@ arrange(monitor_t *m, desktop_t *d)
         rect.height -= d->window_gap;
     }
 
+    return rect;
+}
+
+static unsigned int
+layout_border_width(monitor_t *m, desktop_t *d, node_t *n)
+{
+    if (n->client == NULL || !is_leaf(n))
+        return 0;
+
+    bool the_only_window = !m->prev && !m->next && d->root->client;
+
+    if ((borderless_monocle && data->layout == LAYOUT_MONOCLE && IS_TILED(n->client)) ||
+        (borderless_singleton && the_only_window) ||
+        n->client->state == STATE_FULLSCREEN)
+            return 0;
+
+    return n->client->border_width;
+}
+
+/* The rectangle of a tiled or pseudo-tiled client within the one of its leaf. */
+static xcb_rectangle_t
+tiled_rectangle(desktop_t *d, node_t *n, xcb_rectangle_t rect, unsigned int bw)
+{
+    client_state_t s = n->client->state;
+    int wg = (gapless_monocle && d->layout == LAYOUT_MONOCLE ? 0 : d->window_gap);
+    xcb_rectangle_t r = rect;
+    int bleed = wg + 2 * bw;
+
+    r.width = (bleed < r.width ? r.width - bleed : 1);
+    r.height = (bleed < r.height ? r.height - bleed : 1);
+
+    if (s == STATE_PSEUDO_TILED) {
+        xcb_rectangle_t f = n->client->floating_rectangle;
+        r.width = MIN(r.width, f.width);
+        r.height = MIN(r.height, f.height);
+
+        if (center_pseudo_tiled) {
+            r.x = rect.x - bw + (rect.width - wg - r.width) / 2;
+            r.y = rect.y - bw + (rect.height - wg - r.height) / 2;
+        }
+    }
+
+    return r;
+}
+
+/* Where the fence between the children of an internal node goes. */
+static void
+split_rectangle(desktop_t *d, node_t *n, xcb_rectangle_t rect, xcb_rectangle_t *first_rect,
+    xcb_rectangle_t *second_rect)
+{
+    if (d->layout == LAYOUT_MONOCLE || n->first_child->vacant || n->second_child->vacant) {
+        *first_rect = *second_rect = rect;
+
+        return;
+    }
+
+    unsigned int fence;
+
+    if (n->split_type == TYPE_VERTICAL) {
+        fence = rect.width * n->split_ratio;
+
+        if ((n->first_child->constraints.min_width + n->second_child->constraints.min_width) <=
+            rect.width) {
+            if (fence < n->first_child->consraints.min_width) {
+                fence = n->first_child->constraints.min_width;
+                n->split_ratio = (double)fence / (double)rect.width;
+            } else if (fence > (uint16_t)(rect.width - n->second_child->constraints.min_width)) {
+                fence = (rect.width - n->second_child->constraints.min_width);
+                n->split_ration = (double)fence / (double)rect.width;
+            }
+        }
+
+        *first_rect = (xcb_rectangle_t) { rect.x, rect.y, fence, rect.height };
+        *second_rect = (xcb_rectangle_t) { rect.x + fence, rect.y, rect.width - fence, rect.height };
+    } else {
+        fence = rect.height * n->split_ratio;
+
+        if ((n->first_child->constraints.min_height + n->second_child->constraints.min_height) <=
+            rect.height) {
+            if (fence < n->first_child->constraints.min_height) {
+                fence = n->first_child.constraints.min_height;
+                n->split_ratio = (double)fence / (double)rect.height;
+            } else if (fence > (uint16_t)(rect.height - n->second_child->constraints.min_height)) {
+                fence = (rect.height - n->second_child->constraints.min_height);
+                n->split_ratio = (double)fence / (double)rect.height;
+            }
+        }
+
+        *first_rect = (xcb_rectangle_t) { rect.x, rect.y, rect.width, fence };
+        *second_rect = (xcb_rectangle_t) { rect.x, rect.y + fence, rect.width, rect.height - fence};
+    }
+}
+
+/**
+ * The geometry apply_layout() is going to give the nodes, computed without
+ * sending anything to the server nor updating what's remembered of the
+ * last layout, so that the desktop still gets arranged as usual.
+**/
+static void
+settle_layout(monitor_t *m, desktop_t *d, node_t *n, xcb_rectangle_t rect)
+{
+    if (n == NULL)
+        return;
+
+    n->rectangle = rect;
+
+    if (is_leaf(n)) {
+        if (n->client != NULL && (n->client->state == STATE_TILED ||
+            n->client->state == STATE_PSEUDO_TILED))
+                n->client->tiled_rectangle = tiled_rectangle(d, n, rect,
+                    layout_border_width(m, d, n));
+    } else {
+        xcb_rectangle_t first_rect;
+        xcb_rectangle_t second_rect;
+
+        split_rectangle(d, n, rect, &first_rect, &second_rect);
+        settle_layout(m, d, n->first_child, first_rect);
+        settle_layout(m, d, n->second_child, second_rect);
+    }
+}
+
+/**
+ * Used by the code reading the geometry of the nodes of a desktop that
+ * might not have been laid out yet. The windows are left alone until the
+ * desktop is actually arranged.
+**/
+void
+arrange_pending(monitor_t *m, desktop_t *d)
+{
+    if (m == NULL || d == NULL || !d->dirty || d->settled == layout_epoch || d->root == NULL)
+        return;
+
+    d->settled = layout_epoch;
+    settle_layout(m, d, d->root, desktop_rectangle(m, d));
+}
+
+void
+arrange_now(monitor_t *m, desktop_t *d)
+{
+    if (d->dirty) {
+        d->dirty = false;
+        dirty_desktops--;
+    }
+
+    d->settled = 0;
+
+    if (d->root == NULL)
+        return;
+
+    xcb_rectangle_t rect = desktop_rectangle(m, d);
+
     apply_layout(m, d, d->root, rect, rect);
 }
 
+static bool
+layout_key_eq(layout_key_t *a, layout_key_t *b)
+{
+    return a->valid && b->valid && rect_eq(a->rectangle, b->rectangle) &&
+        a->split_ratio == b->split_ratio && a->split_type == b->split_type &&
+        a->layout == b->layout && a->window_gap == b->window_gap &&
+        a->border_width == b->border_width;
+}
+
 void
 apply_layout(monitor_t *m, desktop_t *d, node_t *n, xcb_rectangle_t rect, xcb_rectangle_t root_rect)
 {
     if (n == NULL)
         return;
 
+    unsigned int bw = layout_border_width(m, d, n);
+
+    layout_key_t key = {
+        .rectangle = rect,
+        .split_ratio = n->split_ratio,
+        .split_type = n->split_type,
+        .layout = d->layout,
+        .window_gap = (gapless_monocle && d->layout == LAYOUT_MONOCLE ? 0 : d->window_gap),
+        .border_width = bw,
+        .valid = true,
+    };
+
+    if (!n->layout_dirty && layout_key_eq(&n->layout_key, &key))
+        return;
+
+    /* The rectangle itself might have been settled in advance, see arrange_pending(). */
+    if (!n->layout_key.valid || !rect_eq(n->layout_key.rectangle, rect) ||
+        n->layout_key.split_ratio != key.split_ratio ||
+        n->layout_key.split_type != key.split_type)
+            touch_node(n);
+
+    n->layout_key = key;
+    n->layout_dirty = false;
     n->rectangle = rect;
 
     if (n->presel != NULL)
@@ -67,38 +299,11 @@ apply_layout(monitor_t *m, desktop_t *d, node_t *n, xcb_rectangle_t rect, xcb_re
         if (n->client == NULL)
             return;
 
-        unsigned int bw;
-        bool the_only_window = !m->prev && !m->next && d->root->client;
-
-        if ((borderless_monocle && data->layout == LAYOUT_MONOCLE && IS_TILED(n->client)) ||
-            (borderless_singleton && the_only_window) ||
-            n->client->state == STATE_FULLSCREEN)
-                bw = 0;
-        else
-                bw = n->client->border_width;
-
         xcb_rectangle_t r, xcb_rectangle_t = get_window_rectangle(n);
 
         /* Tiled and pseudo-tiled client */
         if (s == STATE_TILED || s == STATE_PSEUDO_TILED) {
-            int wg = (gapless_monocle && d->layout == LAYOUT_MONOCLE ? 0 : d->window_gap);
-            r = rect;
-            int bleed = wg + 2 * bw;
-
-            r.width = (bleed < r.width ? r.width - bleed : 1);
-            r.height = (bleed < r.height ? r.height - bleed : 1);
-
-            if (s == STATE_PSEUDO_TILED) {
-                xcb_rectangle_t f = n->client->floating_rectangle;
-                r.width = MIN(r.width, f.width);
-                r.height = MIN(r.height, f.height);
-
-                if (center_pseudo_tiled) {
-                    r.x = rect.x - bw + (rect.width - wg - r.width) / 2;
-                    r.y = rect.y - bw + (rect.height - wg - r.height) / 2;
-                }
-            }
-
+            r = tiled_rectangle(d, n, rect, bw);
             n->client->tiled_rectangle = r;
         } else if (s == STATE_FLOATING) {
             r = n->client->floating_rectangle;
@@ -124,46 +329,13 @@ apply_layout(monitor_t *m, desktop_t *d, node_t *n, xcb_rectangle_t rect, xcb_re
         xcb_rectangle_t first_rect;
         xcb_rectangle_t second_rect;
 
-        if (d->layout == LAYOUT_MONOCLE || n->first_child->vacant || n->second_child->vacant) {
-            first_rect = second_rect = rect;
-        } else {
-            unsigned int fence;
-
-            if (n->split_type == TYPE_VERTICAL) {
-                fence = rect.width * n->split_ratio;
-
-                if ((n->first_child->constraints.min_width + n->second_child->constraints.min_width) <=
-                    rect.width) {
-                    if (fence < n->first_child->consraints.min_width) {
-                        fence = n->first_child->constraints.min_width;
-                        n->split_ratio = (double)fence / (double)rect.width;
-                    } else if (fence > (uint16_t)(rect.width - n->second_child->constraints.min_width)) {
-                        fence = (rect.width - n->second_child->constraints.min_width);
-                        n->split_ration = (double)fence / (double)rect.width;
-                    }
-                }
-
-                first_rect = (xcb_rectangle_t) { rect.x, rect.y, fence, rect.height };
-                second_rect = (xcb_rectangle_t) { rect.x + fence, rect.y, rect.width - fence, rect.height };
-            } else {
-                fence = rect.height * n->split_ratio;
-
-                if ((n->first_child->constraints.min_height + n->second_child->constraints.min_height) <=
-                    rect.height) {
-                    if (fence < n->first_child->constraints.min_height) {
-                        fence = n->first_child.constraints.min_height;
-                        n->split_ratio = (double)fence / (double)rect.height;
-                    } else if (fence > (uint16_t)(rect.height - n->second_child->constraints.min_height)) {
-                        fence = (rect.height - n->second_child->constraints.min_height);
-                        n->split_ratio = (double)fence / (double)rect.height;
-                    }
-                }
+        split_rectangle(d, n, rect, &first_rect, &second_rect);
 
-                first_rect = (xcb_rectangle_t) { rect.x, rect.y, rect.width, fence };
-                second_rect = (xcb_rectangle_t) { rect.x, rect.y + fence, rect.width, rect.height - fence};
-            }
-        }
+        /* The constraints might have moved the fence. */
+        if (n->split_ratio != key.split_ratio)
+            touch_node(n);
 
+        n->layout_key.split_ratio = n->split_ratio;
         apply_layout(m, d, n->first_child, first_rect, root_rect);
         apply_layout(m, d, n->second_child, second_rect, root_rect);
     }
@@ -172,7 +344,7 @@ apply_layout(monitor_t *m, desktop_t *d, node_t *n, xcb_rectangle_t rect, xcb_re
 presel_t *
 make_presel(void)
 {
-    presel_t *p = calloc(1, sizeof(presel_t));
+    presel_t *p = pool_alloc(&presel_pool);
 
     p->split_dir = DIR_EAST;
     p->split_ration = split_ratio;
@@ -188,15 +360,19 @@ set_ratio(node_t *n, double rat)
         return;
 
     n->split_ratio = rat;
+    invalidate_layout(n);
 }
 
 void
 presel_dir(monitor_t *m,, desktop_t *d, node_t *n, direction_t dir)
 {
-    if (n->presel == NULL)
+    if (n->presel == NULL) {
         n->presel = make_presel();
+        update_node_flags(n);
+    }
 
     n->presel->split_dir = dir;
+    invalidate_layout(n);
     put_status(SBSC_MASK_NODE_PRESEL, "node_presel 0x%08X 0x%08X 0x%08X dir %s\n", m->id, d->id,
         n->id, SPLIT_DIR_STR(dir));
 }
@@ -204,10 +380,13 @@ presel_dir(monitor_t *m,, desktop_t *d, node_t *n, direction_t dir)
 void
 presel_ratio(monitor_t *m, desktop_t *d, node_t *n, double ratio)
 {
-    if (n->presel == NULL)
+    if (n->presel == NULL) {
         n->presel = make_presel();
+        update_node_flags(n);
+    }
 
     n->presel->split_ratio = ratio;
+    invalidate_layout(n);
     put_status(SBSC_MASK_NODE_PRESEL, "node_presel 0x%08X 0x%08X ratio %lf\n", m->id, d->id,
         n->id, ratio);
 }
@@ -221,8 +400,9 @@ cancel_preset(monitor_t *m, desktop_t *d, node_t *n)
     if (n->presel->feedback != XCB_NONE)
         xcb_destroy_window(dpy, n->preset->feedback);
 
-    free(n->presel);
+    pool_free(&presel_pool, n->presel);
     n->presel = NULL;
+    update_node_flags(n);
     put_status(SBSC_MASK_NODE_PRESEL, "node_presel 0x%08X 0x%08X 0x%08X cancel\n", m->id, d->id, n->id);
 }
 
@@ -293,17 +473,26 @@ insert_node(monitor_t *m, desktop_t *d, node_t *n, node_t *f)
                 p->first_child = n;
             else
                 p->second_child;
+
+            touch_node(p);
         } else {
             d->root = n;
+            touch_desktop(d);
         }
 
         n->parent = p;
-        free(f);
+        index_remove(f);
+        bury(TOMBSTONE_NODE, f->id);
+        pool_free(&node_pool, f);
         f = NULL;
     } else {
         node_t *c = make_node(XCB_NONE);
         node_t *p = f->parent;
 
+        /* The automatic insertion schemes look at the current geometry. */
+        if (f->presel == NULL)
+            arrange_pending(m, d);
+
         if (f->presel == NULL && (f->private || private_count(f->parent) > 0)) {
             node_t *k = find_public(d);
 
@@ -438,8 +627,22 @@ insert_node(monitor_t *m, desktop_t *d, node_t *n, node_t *f)
             cancel_presel(m, d, f);
             set_marked(m, d, n, false);
         }
+
+        index_add(m, d, c);
+    }
+
+    index_add_in(m, d, n);
+    invalidate_layout(n);
+    touch_node_in(n);
+
+    if (n->parent != NULL) {
+        touch_node(n->parent);
+        touch_node(n->parent->parent);
     }
 
+    if (d->root == n || d->root == n->parent)
+        touch_desktop(d);
+
     m->sticky_count += sticky_count(n);
     property_flags_upward(m, d, n);
 
@@ -709,7 +912,7 @@ make_node(uint32_t id)
     if (id == XCB_NONE)
         id = xcb_generate_id(dpy);
 
-    node_t *n = calloc(1, sieof(node_t));
+    node_t *n = pool_alloc(&node_pool);
 
     n->id = id;
     n->parent = n->first_child = n->second_child = NULL;
@@ -717,8 +920,14 @@ make_node(uint32_t id)
     n->split_ratio = split_ratio;
     n->split_type = TYPE_VERTICAL;
     n->constraints = (constraints_t) { MIN_WIDTH, MIN_HEIGHT };
+    n->layout_key.valid = false;
+    n->layout_dirty = true;
+    n->generation = next_generation();
     n->presel = NULL;
     n->client = NULL;
+    n->hist = NULL;
+    n->stack = NULL;
+    update_node_flags(n);
 
     return n;
 }
@@ -726,56 +935,63 @@ make_node(uint32_t id)
 client_t *
 make_client(void)
 {
-    client_t *c = calloc(1, sizeof(client_t));
+    client_t *c = pool_alloc(&client_pool);
+    c->info = pool_alloc(&client_info_pool);
     c->state = c->last_state = STATE_TILED;
     c->layer = c->last_layer = LAYER_NORMAL;
 
-    snprintf(c->class_name, sizeof(c->class_name), "%s", MISSING_VALUE);
-    snprintf(c->instance_name, sizeof(c->instance_name), "%s", MISSING_VALUE);
+    c->class_id = intern(MISSING_VALUE);
+    c->instance_id = intern(MISSING_VALUE);
 
     c->border_width = border_width;
     c->urgent = false;
     c->shown = false;
     c->wm_flags = 0;
 
-    c->icccm_props.input_hint = true;
-    c->icccm_props.take_focus = false;
-    c->icccm_props.delete_window = false;
-    c->size_hints.flags = 0;
+    c->info->icccm_props.input_hint = true;
+    c->info->icccm_props.take_focus = false;
+    c->info->icccm_props.delete_window = false;
+    c->info->size_hints.flags = 0;
+    c->shadow.known = 0;
 
     return c;
 }
 
+/**
+ * Without prefetched properties, the client is initialized from a fresh
+ * fetch of its window's properties.
+**/
 void
-initialize_client(node_t *n)
+initialize_client(node_t *n, window_props_t *wp)
 {
-    xcb_window_t win = n->id;
     client_t *c = n->client;
-    xcb_icccm_get_wm_protocols_reply_t protos;
+    window_props_t *own = NULL;
 
-    if (xcb_icccm_get_wm_protocols_reply(dpy, xcb_icccm_get_wm_protocols(dpy, win,
-        ewmh->WM_PROTOCOLS), &protos, NULL) == 1) {
-            uint32_t i;
+    if (wp == NULL)
+        wp = own = fetch_window_props(n->id);
 
-            for (i = 0; i < protos.atoms_len; i++) {
-                if (protos.atoms[i] == WM_TAKE_FOCUS)
-                    c->icccm_props.take_focus = true;
-                else if (protos.atom[i] == WM_DELETE_WINDOW)
-                    c->icccm_props.delete_window = true;
-            }
+    if (wp == NULL)
+        return;
 
-            xcb_icccm_get_wm_protocols_reply_wipe(&protos);
-    }
+    if (wp->has_protocols) {
+        uint32_t i;
 
-    xcb_ewmh_get_atoms_reply_t wm_state;
+        for (i = 0; i < wp->protocols.atoms_len; i++) {
+            if (wp->protocols.atoms[i] == WM_TAKE_FOCUS)
+                c->info->icccm_props.take_focus = true;
+            else if (wp->protocols.atoms[i] == WM_DELETE_WINDOW)
+                c->info->icccm_props.delete_window = true;
+        }
+    }
 
-    if (xcb_ewmh_get_wm_state_reply(ewmh, xcb_ewmh_get_wm_state(ewmh, win), &wm_state, NULL) == 1) {
+    if (wp->has_wm_state) {
         unsigned int i;
 
-        for (i = 0; i < wm_state.atoms_len && i < MAX_WM_STATE; i++) {
+        for (i = 0; i < wp->wm_state.atoms_len && i < MAX_WM_STATE; i++) {
 #define HANDLE_WM_STATE(s)                                                     \
-            if (wm_state.atoms[i] == ewmh->_NET_WM_STATE_##s)                  \
+            if (wp->wm_state.atoms[i] == ewmh->_NET_WM_STATE_##s) {            \
                 c->wm_flags |= WM_FLAG_##s; continue;                          \
+            }
             HANDLE_WM_STATE(MODAL)
             HANDLE_WM_STATE(STICKY)
             HANDLE_WM_STATE(MAXIMIXED_VERT)
@@ -790,18 +1006,15 @@ initialize_client(node_t *n)
             HANDLE_WM_STATE(DEMANDS_ATTENTION)
 #undef HANDLE_WM_STATE
         }
-
-        xcb_ewmh_get_atoms_reply_wipe(&wm_state);
     }
 
-    xcb_icccm_wm_hints_t hints;
+    if (wp->has_hints && (wp->hints.flags & XCB_ICCCM_WM_HINT_INPUT))
+        c->info->icccm_props.input_hint = wp->hints.input;
 
-    if (xcb_icccm_get_wm_hints_reply(dpy, xcb_icccm_get_wm_hints(dpy, win, &hints, NULL) == 1 &&
-        (hints.flags & XCB_ICCCM_WM_HINT_INPUT)))
-            c->icccm_props.input_hint = hints.input;
+    if (wp->has_size_hints)
+        c->info->size_hints = wp->size_hints;
 
-    xcb_icccm_get_wm_normal_hints_reply(dpy, xcb_icccm_get_wm_normal_hints(dpy, win),
-        &c->size_hints, NULL);
+    free_window_props(own);
 }
 
 bool
@@ -1072,25 +1285,7 @@ is_descendent(node_t *a, node_t *b)
 bool
 find_by_id(uint32_t id, coordinates_t *loc)
 {
-    monitor_t *m;
-
-    for (*m = mon_head; m != NULL; m = m->next) {
-        desktop_t *d;
-
-        for (*d = m->desk_head; d != NULL; d = d->next) {
-            node_t *n = find_by_id_in(d->root, id);
-
-            if (n != NULL) {
-                loc->monitor = m;
-                loc->desktop = d;
-                loc->node = n;
-
-                return true;
-            }
-        }
-    }
-
-    return false;
+    return index_find(id, loc);
 }
 
 node_t *
@@ -1171,7 +1366,8 @@ find_nearest_neighbor(coordinates_t *ref, coordinates_t *dst, direction_t dir,
     node_select_t *sel)
 {
     xcb_rectangle_t rect = get_rectangle(ref->monitor, ref->desktop, ref->node);
-    uint32_t md = UINT32_MAX, mr = UINT32_MAX;
+    uint32_t md = UINT32_MAX;
+    uint64_t mr = UINT64_MAX;
     monitor_t *m;
 
     for (*m = mon_head; m != NULL; m = m->next) {
@@ -1188,7 +1384,7 @@ find_nearest_neighbor(coordinates_t *ref, coordinates_t *dst, direction_t dir,
                     continue;
 
             uint32_t fd = boundary_distance(rect, r, dir);
-            uint32_t fr = history_rank(f);
+            uint64_t fr = history_rank(f);
 
             if (fd < md || (fd == md && fr < mr)) {
                 md = fd;
@@ -1267,6 +1463,7 @@ rotate_tree(node_t *n, int deg)
 {
     rotate_tree_rec(n, deg);
     rebuild_constraints(n);
+    invalidate_layout_in(n);
 }
 
 void
@@ -1284,6 +1481,7 @@ rotate_tree_rec(node_t *n, int deg)
             n->first_child = n->second_child;
             n->second_child = tmp;
             n->split_ratio = 1.0 - n->split_ratio;
+            touch_node(n);
     }
 
     if (deg > 180) {
@@ -1311,6 +1509,8 @@ flip_tree(node_t *n, flip_t flip)
             n->first_child = n->second_child;
             n->second_child = tmp;
             n->split_ratio = 1.0 - n->split_ratio;
+            invalidate_layout(n);
+            touch_node(n);
     }
 
     flip_tree(n->first_child, flip);
@@ -1324,6 +1524,7 @@ equalize_tree(node_t *n)
         return;
     } else {
         n->split_ratio = split_ratio;
+        invalidate_layout(n);
         equalize_tree(n->first_child);
         equalize_tree(n->second_child);
     }
@@ -1344,6 +1545,8 @@ balance_tree(node_t *n)
         if (b1 > 0 && b2 > 0)
             n->split_ratio = (double)b1 / b;
 
+        invalidate_layout(n);
+
         return b;
     }
 }
@@ -1371,6 +1574,7 @@ adjust_ratios(node_t *n, xcb_rectangle_t rect)
     ratio = MAX(0.0, ratio);
     ratio = MIN(1.0, ratio);
     n->split_ratio = ratio;
+    invalidate_layout(n);
 
     xcb_rectangle_t first_rect;
     xcb_rectangle_t second_rect;
@@ -1400,12 +1604,18 @@ unlink_node(monitor_t *m, desktop_t *d, node_t *n)
 
     node_t *p = n->parent;
 
+    /* The removal adjustment might look at the geometry of the parent. */
+    if (p != NULL && !n->vacant && removal_adjustment && automatic_scheme != SCHEME_SPIRAL &&
+        (automatic_scheme == SCHEME_LONGEST_SIDE || p->parent == NULL))
+            arrange_pending(m, d);
+
     if (m->sticky_count > 0)
         m->sticky_count -= sticky_count(n);
 
     if (p == NULL) {
         d->root = NULL;
         d->focus = NULL;
+        touch_desktop(d);
     } else {
         if (d->focus == p || is_descendent(d->focus, n))
             d->focus = NULL;
@@ -1427,6 +1637,7 @@ unlink_node(monitor_t *m, desktop_t *d, node_t *n)
                 g->second_child = b;
         } else {
             d->root = b;
+            touch_desktop(d);
         }
 
         if (!n->vacant && removal_adjustment) {
@@ -1450,8 +1661,13 @@ unlink_node(monitor_t *m, desktop_t *d, node_t *n)
             }
         }
 
-        free(p);
+        index_remove(p);
+        bury(TOMBSTONE_NODE, p->id);
+        pool_free(&node_pool, p);
         n->parent = NULL;
+        invalidate_layout(b);
+        touch_node(b);
+        touch_node(g);
         propogate_flags_upward(m, d, b);
     }
 }
@@ -1462,7 +1678,7 @@ class_node(node_t *n)
     if (n == NULL) {
         return;
     } else if (n->client != NULL) {
-        if (n->client->icccm_props.delete_window)
+        if (n->client->info->icccm_props.delete_window)
             send_client_message(n->id, ewmh->WM_PROTOCOLS, WM_DELETE_WINDOW);
         else
             xcb_kill_client(dpy, n->id);
@@ -1528,8 +1744,17 @@ free_node(node_t *n)
     node_t *first_child = n->first_child;
     node_t *second_child = n->second_child;
 
-    free(n->client);
-    free(n);
+    index_remove(n);
+    bury(TOMBSTONE_NODE, n->id);
+
+    if (n->client != NULL) {
+        intern_release(n->client->class_id);
+        intern_release(n->client->instance_id);
+        pool_free(&client_info_pool, n->client->info);
+    }
+
+    pool_free(&client_pool, n->client);
+    pool_free(&node_pool, n);
 
     free_node(first_child);
     free_node(second_child);
@@ -1572,6 +1797,10 @@ swap_nodes(monitor_t *m1, desktop_t *d1, node_t *n1, monitor_t *m2, desktop_t *d
 
     n1->parent = pn2;
     n2->parent = pn1;
+    invalidate_layout(n1);
+    invalidate_layout(n2);
+    touch_node(pn1);
+    touch_node(pn2);
     propogate_flags_upward(m2, d2, n1);
     propogate_flags_upward(m1, d1, n2);
 
@@ -1582,6 +1811,11 @@ swap_nodes(monitor_t *m1, desktop_t *d1, node_t *n1, monitor_t *m2, desktop_t *d
         if (d2->root == n2)
             d2->root = n1;
 
+        index_add_in(m2, d2, n1);
+        index_add_in(m1, d1, n2);
+        touch_node_in(n1);
+        touch_node_in(n2);
+
         if (n1_held_focus)
             d1->focus = n2_held_focus ? last_d2_focus : n2;
 
@@ -1871,6 +2105,7 @@ set_vacant_local(monitor_t *m, desktop_t *d, node_t *n, bool value)
         return;
 
     n->vacant = value;
+    invalidate_layout(n);
 
     if (value)
         cancel_presel(m, d, n);
@@ -1909,6 +2144,7 @@ set_layer(monitor_t *m, desktop_t *d, node_t *n, stack_layer_t l)
 
     n->client->last_layer = n->client->layer;
     n->client->layer = l;
+    update_node_flags(n);
 
     if (l == LAYER_ABOVE) {
         n->client->wm_flags |= WM_FLAG_ABOVE;
@@ -1942,6 +2178,8 @@ set_state(monitor_t *m, desktop_t *d, node_t *n, client_state_t s)
     bool was_tiled = IS_TILED(c);
     c->last_state = c->state;
     c->state = s;
+    update_node_flags(n);
+    invalidate_layout(n);
 
     switch (c->last_state) {
     case STATE_TILED:
@@ -2081,6 +2319,8 @@ update_constraints(node_t *n)
         n->constraints.min_height = n->first_child->constraints.min_height +
             n->second_child->constraints.min_height;
     }
+
+    invalidate_layout(n);
 }
 
 void
@@ -2140,6 +2380,7 @@ set_hidden_local(monitor_t *m, desktop_t *d, node_t *n, bool value)
         return;
 
     n->hidden = value;
+    update_node_flags(n);
 
     if (n->client != NULL) {
         if (n->client->shown)
@@ -2192,6 +2433,7 @@ set_sticky(monitor_t *m, desktop_t *d, node_t *n, bool value)
         transfer_node(m, d, n, m, m->desk, m->desk->focus, false);
 
     n->sticky = value;
+    update_node_flags(n);
 
     if (value)
         m->sticky_count++;
@@ -2221,6 +2463,7 @@ set_private(monitor_t *m, desktop_t *d, node_t *n, bool value)
         return;
 
     n->private = value;
+    update_node_flags(n);
     put_status(SBSC_MASK_NODE_FLAG, "node_flag 0x%08X 0x%08X 0x%08X private %s\n",
         m->id, d->id, n->id, ON_OFF_STR(value));
 
@@ -2235,6 +2478,7 @@ set_locked(monitor_t *m, desktop_t *d, node_t *n, bool value)
         return;
 
     n->locked = value;
+    update_node_flags(n);
     put_status(SBSC_MASK_NODE_FLAG, "node_flag 0x%08X 0x%08X 0x%08X locked %s\n",
         m->id, d->id, n->id, ON_OFF_STR(value));
 
@@ -2249,6 +2493,7 @@ set_marked(monitor_t *m, desktop_t *d, node_t *n, bool value)
         return;
 
     n->marked = value;
+    update_node_flags(n);
     put_status(SBSC_MASK_NODE_FLAG, "node_flag 0x%08X 0x%08X 0x%08X marked %s\n",
         m->id, d->id, n->id, ON_OFF_STR(value));
 
@@ -2263,6 +2508,7 @@ set_urgent(monitor_t *m, desktop_t *d, node_t *n, bool value)
         return;
 
     n->client->urgent = value;
+    update_node_flags(n);
 
     if (value)
         n->client->num_flags |= WM_FLAG_DEMANDS_ATTENTION;
@@ -2275,12 +2521,82 @@ set_urgent(monitor_t *m, desktop_t *d, node_t *n, bool value)
     put_status(SBSC_MASK_REPORT);
 }
 
+/* Gather what the node holds into its flag word, after any of it changed. */
+void
+update_node_flags(node_t *n)
+{
+    uint32_t f = 0;
+
+    if (n->presel == NULL)
+        f |= NODE_FLAG_AUTOMATIC;
+
+    if (n->hidden)
+        f |= NODE_FLAG_HIDDEN;
+
+    if (n->sticky)
+        f |= NODE_FLAG_STICKY;
+
+    if (n->private)
+        f |= NODE_FLAG_PRIVATE;
+
+    if (n->locked)
+        f |= NODE_FLAG_LOCKED;
+
+    if (n->marked)
+        f |= NODE_FLAG_MARKED;
+
+    if (n->client != NULL) {
+        client_t *c = n->client;
+        f |= NODE_FLAG_WINDOW;
+
+        if (c->state == STATE_TILED)
+            f |= NODE_FLAG_TILED;
+        else if (c->state == STATE_PSEUDO_TILED)
+            f |= NODE_FLAG_PSEUDO_TILED;
+        else if (c->state == STATE_FLOATING)
+            f |= NODE_FLAG_FLOATING;
+        else if (c->state == STATE_FULLSCREEN)
+            f |= NODE_FLAG_FULLSCREEN;
+
+        if (c->layer == LAYER_BELOW)
+            f |= NODE_FLAG_BELOW;
+        else if (c->layer == LAYER_NORMAL)
+            f |= NODE_FLAG_NORMAL;
+        else if (c->layer == LAYER_ABOVE)
+            f |= NODE_FLAG_ABOVE;
+
+        if (c->urgent)
+            f |= NODE_FLAG_URGENT;
+    }
+
+    n->flags = f;
+}
+
+/* The stored flags, along with the ones that depend on the surrounding tree. */
+uint32_t
+node_flags(node_t *n)
+{
+    uint32_t f = n->flags;
+
+    if (is_leaf(n))
+        f |= NODE_FLAG_LEAF;
+
+    if (n->split_type == TYPE_HORIZONTAL)
+        f |= NODE_FLAG_HORIZONTAL;
+    else if (n->split_type == TYPE_VERTICAL)
+        f |= NODE_FLAG_VERTICAL;
+
+    return f;
+}
+
 xcb_rectangle_t
 get_rectangle(monitor_t *m, desktop_t *d, node_t *n)
 {
     if (n == NULL)
         return m->rectangle;
 
+    arrange_pending(m, d);
+
     client_t *c = n->client;
 
     if (c != NULL) {
@@ -2316,13 +2632,52 @@ listen_enter_notify(node_t *n, bool enable)
     }
 }
 
+/**
+ * Mark a node, and its ancestors, as needing to be laid out again even
+ * though the rectangle it will be given might not change.
+**/
+void
+invalidate_layout(node_t *n)
+{
+    layout_epoch++;
+
+    for (; n != NULL; n = n->parent)
+        n->layout_dirty = true;
+}
+
+void
+invalidate_layout_in(node_t *n)
+{
+    if (n == NULL)
+        return;
+
+    invalidate_layout(n);
+    invalidate_layout_in(n->first_child);
+    invalidate_layout_in(n->second_child);
+}
+
+/* For the settings the layout keys don't cover. */
+void
+invalidate_all_layouts(void)
+{
+    for (monitor_t *m = mon_head; m != NULL; m = m->next) {
+        for (desktop_t *d = m->desk_head; d != NULL; d = d->next) {
+            invalidate_layout_in(d->root);
+            arrange(m, d);
+        }
+    }
+}
+
 void
 regenerate_ids_in(node_t *n)
 {
     if (n == NULL || n->client != NULL)
         return;
 
+    uint32_t id = n->id;
+
     n->id = xcb_generate_id(dpy);
+    index_rekey(id, n->id);
     regenerate_ids_in(n->first_child);
     regenerate_ids_in(n->second_child);
 }
@@ -10,6 +10,9 @@
 #define MIN_HEIGHT 32
 
 void arrange(monitor_t *m, desktop_t *d);
+void arrange_dirty(void);
+void arrange_pending(monitor_t *m, desktop_t *d);
+void arrange_now(monitor_t *m, desktop_t *d);
 void apply_layout(monitor_t *m, desktop_t *d, node_t *n, xcb_rectangle_t rect,
     xcb_rectangle_t root_rect);
 presel_t *make_presel(void);
@@ -28,7 +31,7 @@ void hide_node(desktop_t *d, node_t *n);
 void show_node(desktop_t *d, node_t *n);
 node_t *make_node(uint32_t id);
 client_t *make_client(void);
-void initialize_client(node_t *n);
+void initialize_client(node_t *n, window_props_t *wp);
 bool is_focusable(node_t *n);
 bool is_leaf(node_t *n);
 bool is_first_child(node_t *n);
@@ -100,8 +103,13 @@ void set_private(monitor_t *m, desktop_t *d, node_t *n, bool value);
 void set_locked(monitor_t *m, desktop_t *d, node_t *n, bool value);
 void set_marked(monitor_t *m, desktop_t *d, node_t *n, bool value);
 void set_urgent(monitor_t *m, desktop_t *d, node_t *n, bool value);
+void update_node_flags(node_t *n);
+uint32_t node_flags(node_t *n);
 xcb_rectangle_t get_rectangle(monitor_t *m, desktop_t *d, node_t *n);
 void listen_enter_notify(node_t *n, bool enable);
+void invalidate_layout(node_t *n);
+void invalidate_layout_in(node_t *n);
+void invalidate_all_layouts(void);
 void regenerate_ids_in(node_t *n);
 
 unsigned int sticky_count(node_t *n);
@@ -9,6 +9,7 @@
 #include <stdbool.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_icccm.h>
+#include <xcb/xcb_ewmh.h>
 #include <xcb/randr.h>
 #include <xcb/xcb_event.h>
 
@@ -143,6 +144,104 @@ typedef enum {
     STATE_TRANSITION_EXIT = 1 << 1,
 } state_transition_t;
 
+/**
+ * The fields of each kind of object a query prints. Those that hold the
+ * tree together (children, desktops, roots) are always printed.
+**/
+typedef enum {
+    MONITOR_FIELD_NAME = 1 << 0,
+    MONITOR_FIELD_ID = 1 << 1,
+    MONITOR_FIELD_RANDR_ID = 1 << 2,
+    MONITOR_FIELD_WIRED = 1 << 3,
+    MONITOR_FIELD_STICKY_COUNT = 1 << 4,
+    MONITOR_FIELD_WINDOW_GAP = 1 << 5,
+    MONITOR_FIELD_BORDER_WIDTH = 1 << 6,
+    MONITOR_FIELD_FOCUSED_DESKTOP_ID = 1 << 7,
+    MONITOR_FIELD_PADDING = 1 << 8,
+    MONITOR_FIELD_RECTANGLE = 1 << 9,
+} monitor_field_t;
+
+typedef enum {
+    DESKTOP_FIELD_NAME = 1 << 0,
+    DESKTOP_FIELD_ID = 1 << 1,
+    DESKTOP_FIELD_LAYOUT = 1 << 2,
+    DESKTOP_FIELD_USER_LAYOUT = 1 << 3,
+    DESKTOP_FIELD_WINDOW_GAP = 1 << 4,
+    DESKTOP_FIELD_BORDER_WIDTH = 1 << 5,
+    DESKTOP_FIELD_FOCUSED_NODE_ID = 1 << 6,
+    DESKTOP_FIELD_PADDING = 1 << 7,
+} desktop_field_t;
+
+typedef enum {
+    NODE_FIELD_ID = 1 << 0,
+    NODE_FIELD_SPLIT_TYPE = 1 << 1,
+    NODE_FIELD_SPLIT_RATIO = 1 << 2,
+    NODE_FIELD_VACANT = 1 << 3,
+    NODE_FIELD_HIDDEN = 1 << 4,
+    NODE_FIELD_STICKY = 1 << 5,
+    NODE_FIELD_PRIVATE = 1 << 6,
+    NODE_FIELD_LOCKED = 1 << 7,
+    NODE_FIELD_MARKED = 1 << 8,
+    NODE_FIELD_PRESEL = 1 << 9,
+    NODE_FIELD_RECTANGLE = 1 << 10,
+    NODE_FIELD_CONSTRAINTS = 1 << 11,
+    NODE_FIELD_CLIENT = 1 << 12,
+} node_field_t;
+
+typedef enum {
+    CLIENT_FIELD_CLASS_NAME = 1 << 0,
+    CLIENT_FIELD_INSTANCE_NAME = 1 << 1,
+    CLIENT_FIELD_BORDER_WIDTH = 1 << 2,
+    CLIENT_FIELD_STATE = 1 << 3,
+    CLIENT_FIELD_LAST_STATE = 1 << 4,
+    CLIENT_FIELD_LAYER = 1 << 5,
+    CLIENT_FIELD_LAST_LAYER = 1 << 6,
+    CLIENT_FIELD_URGENT = 1 << 7,
+    CLIENT_FIELD_SHOWN = 1 << 8,
+    CLIENT_FIELD_TILED_RECTANGLE = 1 << 9,
+    CLIENT_FIELD_FLOATING_RECTANGLE = 1 << 10,
+} client_field_t;
+
+/* A mask of zero keeps every field of its kind of object. */
+typedef struct {
+    uint32_t monitor;
+    uint32_t desktop;
+    uint32_t node;
+    uint32_t client;
+} projection_t;
+
+/**
+ * The boolean properties of a node and its client, packed into one word.
+ * The ones held by the node are kept up to date by the functions that
+ * change them, the ones that follow from the shape of the tree are
+ * filled in when needed by node_flags().
+**/
+typedef enum {
+    NODE_FLAG_AUTOMATIC = 1 << 0,
+    NODE_FLAG_WINDOW = 1 << 1,
+    NODE_FLAG_HIDDEN = 1 << 2,
+    NODE_FLAG_STICKY = 1 << 3,
+    NODE_FLAG_PRIVATE = 1 << 4,
+    NODE_FLAG_LOCKED = 1 << 5,
+    NODE_FLAG_MARKED = 1 << 6,
+    NODE_FLAG_TILED = 1 << 7,
+    NODE_FLAG_PSEUDO_TILED = 1 << 8,
+    NODE_FLAG_FLOATING = 1 << 9,
+    NODE_FLAG_FULLSCREEN = 1 << 10,
+    NODE_FLAG_BELOW = 1 << 11,
+    NODE_FLAG_NORMAL = 1 << 12,
+    NODE_FLAG_ABOVE = 1 << 13,
+    NODE_FLAG_URGENT = 1 << 14,
+    NODE_FLAG_LEAF = 1 << 15,
+    NODE_FLAG_HORIZONTAL = 1 << 16,
+    NODE_FLAG_VERTICAL = 1 << 17,
+} node_flag_t;
+
+/* The flags that only a node holding a client can have or lack. */
+#define NODE_FLAGS_CLIENT (NODE_FLAG_TILED | NODE_FLAG_PSEUDO_TILED | NODE_FLAG_FLOATING |   \
+    NODE_FLAG_FULLSCREEN | NODE_FLAG_BELOW | NODE_FLAG_NORMAL | NODE_FLAG_ABOVE |           \
+    NODE_FLAG_URGENT)
+
 typedef struct {
     option_bool_t automatic;
     option_bool_t focused;
@@ -168,6 +267,8 @@ typedef struct {
     option_bool_t above;
     option_bool_t horizontal;
     option_bool_t vertical;
+    uint32_t required;
+    uint32_t forbidden;
 } node_select_t;
 
 typedef struct {
@@ -195,22 +296,53 @@ struct icccm_props_t {
     bool delete_window;
 };
 
+typedef enum {
+    SHADOW_POSITION = 1 << 0,
+    SHADOW_SIZE = 1 << 1,
+    SHADOW_BORDER_WIDTH = 1 << 2,
+    SHADOW_BORDER_PIXEL = 1 << 3,
+    SHADOW_MAPPED = 1 << 4,
+    SHADOW_STACKING = 1 << 5,
+} shadow_flags_t;
+
+/**
+ * What was last sent to the server for a client window; only the fields
+ * flagged in known can be trusted.
+**/
+typedef struct {
+    xcb_rectangle_t rectangle;
+    uint32_t border_width;
+    uint32_t border_pixel;
+    bool mapped;
+    xcb_window_t sibling;
+    uint32_t stack_mode;
+    uint64_t stack_generation;
+    shadow_flags_t known;
+} window_shadow_t;
+
+/* What's only looked at when a window is managed, queried or resized. */
 typedef struct {
-    char class_name[MAXLEN];
-    char instance_name[MAXLEN];
     char name[MAXLEN];
-    unsigned int border_width;
-    bool urgent;
-    bool shown;
+    xcb_size_hints_t size_hints;
+    icccm_props_t icccm_props;
+} client_info_t;
+
+/* What every layout pass and tree walk looks at, kept together. */
+typedef struct {
     client_state_t state;
     client_state_t last_state;
     stack_layer_t layer;
     stack_layer_t last_layer;
+    unsigned int border_width;
+    bool urgent;
+    bool shown;
+    wm_flags_t wm_flags;
     xcb_rectangle_t floating_rectangle;
     xcb_rectangle_t tiled_rectangle;
-    xcb_size_hints_t size_hints;
-    icccm_props_t icccm_props;
-    wm_flags_t wm_flags;
+    window_shadow_t shadow;
+    uint32_t class_id;
+    uint32_t instance_id;
+    client_info_t *info;
 } client_t;
 
 typedef struct presel_t presel_t;
@@ -227,6 +359,24 @@ struct constraints_t {
     uint16_t min_height;
 };
 
+typedef struct layout_key_t layout_key_t;
+
+/**
+ * Everything apply_layout() was given the last time it laid out a node;
+ * a node whose key is unchanged and which isn't marked dirty keeps its
+ * geometry, and so does its whole subtree. The global settings aren't
+ * part of it: changing one invalidates every layout instead.
+**/
+struct layout_key_t {
+    xcb_rectangle_t rectangle;
+    double split_ratio;
+    split_type_t split_type;
+    layout_t layout;
+    int window_gap;
+    unsigned int border_width;
+    bool valid;
+};
+
 typedef struct node_t node_t;
 
 struct node_t {
@@ -242,6 +392,12 @@ struct node_t {
     bool private;
     bool locked;
     bool marked;
+    uint32_t flags;
+    struct history_t *hist;
+    struct stacking_list_t *stack;
+    layout_key_t layout_key;
+    uint64_t generation;
+    bool layout_dirty;
     node_t *first_child;
     node_t *second_child;
     node_t *parent;
@@ -271,6 +427,12 @@ struct desktop_t {
     padding_t padding;
     int window_gap;;
     unsigned int border_width;
+    bool dirty;
+    uint64_t settled;
+    uint64_t generation;
+    struct history_t *hist;
+    struct history_t *hist_head;
+    struct history_t *hist_tail;
 };
 
 typedef struct monitor_t monitor_t;
@@ -289,6 +451,7 @@ struct monitor_t {
     desktop_t *desk;
     desktop_t *desk_head;
     desktop_t *desk_tail;
+    uint64_t generation;
     monitor_t *prev;
     monitor_t *next;
 };
@@ -301,17 +464,25 @@ typedef struct {
 
 typedef struct history_t history_t;
 
+/**
+ * Only the latest entry of each node and desktop is kept. Entries are
+ * chained in focus order, and also per desktop, in the same order, and
+ * their order labels grow from the oldest to the newest.
+**/
 struct history_t {
     coordinates_t loc;
-    bool latest;
+    uint64_t order;
     history_t *prev;
     history_t *next;
+    history_t *desk_prev;
+    history_t *desk_next;
 };
 
 typedef struct stacking_list_t stacking_list_t;
 
 struct stacking_list_t {
     node_t *node;
+    int level;
     stacking_list_t *prev;
     stacking_list_t *next;
 };
@@ -324,32 +495,219 @@ struct event_queue_t {
     event_queue_t *next;
 };
 
+typedef struct event_source_t event_source_t;
+typedef void (*source_handler_t)(event_source_t *src, uint32_t events);
+
+struct event_source_t {
+    int fd;
+    uint32_t events;
+    source_handler_t handler;
+    void *data;
+    event_source_t *next;
+};
+
+/* What a connection deferred since it began its outermost batch. */
+typedef struct {
+    unsigned int depth;
+    int pending;
+    uint64_t deadline;
+    uint32_t *desktops;
+    size_t desktops_len;
+    size_t desktops_cap;
+} batch_t;
+
+typedef struct ipc_client_t ipc_client_t;
+
+struct ipc_client_t {
+    event_source_t *source;
+    char *in;
+    size_t in_len;
+    size_t in_cap;
+    char *out;
+    size_t out_len;
+    size_t out_pos;
+    size_t out_cap;
+    uint64_t deadline;
+    bool opened;
+    bool session;
+    bool eof;
+    bool detached;
+    batch_t batch;
+    ipc_client_t *prev;
+    ipc_client_t *next;
+};
+
+typedef enum {
+    SBSC_POLICY_DROP_OLDEST,
+    SBSC_POLICY_COALESCE,
+    SBSC_POLICY_DISCONNECT,
+} subscriber_policy_t;
+
+/* Formatted once and shared by the queues of every subscriber it goes to. */
+typedef struct {
+    unsigned int refs;
+    char *data;
+    size_t len;
+} subscriber_message_t;
+
+typedef struct {
+    int mask;
+    subscriber_message_t *msg;
+} subscriber_entry_t;
+
+typedef struct throttle_rule_t throttle_rule_t;
+
+/* At most one event of the given kinds per object every interval milliseconds. */
+struct throttle_rule_t {
+    int field;
+    uint32_t interval;
+    throttle_rule_t *next;
+};
+
+typedef struct throttle_entry_t throttle_entry_t;
+
+/**
+ * When the next event of a kind may be sent for an object, and the newest
+ * one held back until then. Chained through `next` in its hash bucket, and
+ * kept at `heap_pos` in the heap ordered by deadline.
+**/
+struct throttle_entry_t {
+    int mask;
+    uint32_t key;
+    uint32_t interval;
+    uint64_t deadline;
+    size_t heap_pos;
+    subscriber_message_t *held;
+    throttle_entry_t *next;
+};
+
 typedef struct subscriber_list_t subscriber_list_t;
 
+/**
+ * Messages wait in a ring until the subscriber's descriptor is writable;
+ * the policy says what to do once they exceed SUBSCRIBER_MAX_PENDING.
+**/
 struct subscriber_list_t {
-    FILE *stream;
+    int fd;
     char *fifo_path;
+    bool fifo_shared;
+    size_t fifo_written;
+    uint64_t stalled_since;
     int field;
     int count;
+    subscriber_policy_t policy;
+    subscriber_entry_t *queue;
+    size_t queue_cap;
+    size_t queue_head;
+    size_t queue_len;
+    size_t pending;
+    size_t sent;
+    bool done;
+    uint32_t monitor_id;
+    uint32_t desktop_id;
+    uint32_t node_id;
+    bool seq;
+    bool resume;
+    uint64_t resume_from;
+    uint64_t replay_next;
+    throttle_rule_t *throttle_rules;
+    int throttle_field;
+    throttle_entry_t **throttle_buckets;
+    throttle_entry_t **throttle_heap;
+    size_t throttle_cap;
+    size_t throttle_len;
+    event_source_t *source;
     subscriber_list_t *prev;
     subscriber_list_t *next;
 };
 
+typedef enum {
+    RULE_EFFECT_MONITOR = 1 << 0,
+    RULE_EFFECT_DESKTOP = 1 << 1,
+    RULE_EFFECT_NODE = 1 << 2,
+    RULE_EFFECT_SPLIT_DIR = 1 << 3,
+    RULE_EFFECT_SPLIT_RATIO = 1 << 4,
+    RULE_EFFECT_STATE = 1 << 5,
+    RULE_EFFECT_LAYER = 1 << 6,
+    RULE_EFFECT_RECTANGLE = 1 << 7,
+    RULE_EFFECT_HIDDEN = 1 << 8,
+    RULE_EFFECT_STICKY = 1 << 9,
+    RULE_EFFECT_PRIVATE = 1 << 10,
+    RULE_EFFECT_LOCKED = 1 << 11,
+    RULE_EFFECT_MARKED = 1 << 12,
+    RULE_EFFECT_CENTER = 1 << 13,
+    RULE_EFFECT_FOLLOW = 1 << 14,
+    RULE_EFFECT_MANAGE = 1 << 15,
+    RULE_EFFECT_FOCUS = 1 << 16,
+    RULE_EFFECT_BORDER = 1 << 17,
+} rule_effect_field_t;
+
+/**
+ * The key=value pairs of a consequence, parsed: `mask` tells which of
+ * the fields are set, and `on` holds the value of the boolean ones. An
+ * invalid rectangle still clears the one set before it.
+**/
+typedef struct {
+    uint32_t mask;
+    uint32_t on;
+    char monitor_desc[MAXLEN];
+    char desktop_desc[MAXLEN];
+    char node_desc[MAXLEN];
+    direction_t split_dir;
+    double split_ratio;
+    client_state_t state;
+    stack_layer_t layer;
+    bool rect_valid;
+    xcb_rectangle_t rect;
+} rule_effect_t;
+
 typedef struct rule_t rule_t;
 
 struct rule_t {
-    char class_name[MAXLEN];
-    char instance_name[MAXLEN];
+    uint32_t class_id;
+    uint32_t instance_id;
     char name[MAXLEN];
     char effect[MAXLEN];
     bool one_shot;
+    uint64_t seq;
+    rule_effect_t delta;
+    struct rule_bucket_t *bucket;
+    rule_t *bucket_prev;
+    rule_t *bucket_next;
     rule_t *prev;
     rule_t *next;
 };
 
+/**
+ * Every property of a newly mapped window we're going to look at, fetched
+ * all at once so that managing it only costs a single round-trip.
+**/
+typedef struct {
+    uint8_t override_redirect;
+    bool has_geometry;
+    xcb_rectangle_t geometry;
+    bool has_window_type;
+    xcb_ewmh_get_atoms_reply_t window_type;
+    bool has_wm_state;
+    xcb_ewmh_get_atoms_reply_t wm_state;
+    bool has_struts;
+    xcb_ewmh_wm_strut_partial_t struts;
+    xcb_window_t transient_for;
+    bool has_size_hints;
+    xcb_size_hints_t size_hints;
+    bool has_hints;
+    xcb_icccm_wm_hints_t hints;
+    bool has_class;
+    xcb_icccm_get_wm_class_reply_t wm_class;
+    bool has_name;
+    xcb_icccm_get_text_property_reply_t wm_name;
+    bool has_protocols;
+    xcb_icccm_get_wm_protocols_reply_t protocols;
+} window_props_t;
+
 typedef struct {
-    char class_name[MAXLEN];
-    char instance_name[MAXLEN];
+    uint32_t class_id;
+    uint32_t instance_id;
     char name[MAXLEN];
     char monitor_desc[MAXLEN];
     char desktop_desc[MAXLEN];
@@ -369,16 +727,19 @@ typedef struct {
     bool focus;
     bool border;
     xcb_rectangle_t *rect;
+    window_props_t *props;
 } rule_consequence_t;
 
 typedef struct pending_rule_t pending_rule_t;
 
 struct pending_rule_t {
     int fd;
+    uint64_t deadline;
     xcb_window_t win;
     rule_consequence_t *csq;
     event_queue_t *event_head;
     event_queue_t *event_tail;
+    event_source_t *source;
     pending_rule_t *prev;
     pending_rule_t *next;
 };
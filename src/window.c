@@ -17,26 +17,20 @@
 #include "rule.h"
 #include "settings.h"
 #include "geometry.h"
+#include "index.h"
 #include "pointer.h"
 #include "stack.h"
 #include "tree.h"
 #include "parse.h"
+#include "intern.h"
 #include "window.h"
 
 void
 schedule_window(xcb_window_t win)
 {
     coordinates_t loc;
-    uint8_t override_redirect = 0;
-    xcb_get_window_attributes_reply_t *wa = xcb_get_window_attributes_reply(dpy,
-        xcb_get_window_attributes(dpy, win), NULL);
-
-    if (wa != NULL) {
-        override_redirect = wa->override_redirect;
-        free(wa);
-    }
 
-    if (override_redirect || locate_window(win, &loc))
+    if (locate_window(win, &loc))
         return;
 
     /* Ignore pending window */
@@ -47,7 +41,16 @@ schedule_window(xcb_window_t win)
             return;
     }
 
+    window_props_t *wp = fetch_window_props(win);
+
+    if (wp != NULL && wp->override_redirect) {
+        free_window_props(wp);
+
+        return;
+    }
+
     rule_consequence_t *csq = make_rule_consequence();
+    csq->props = wp;
     apply_rules(win, csq);
 
     if (!schedule_rules(win, csq)) {
@@ -65,7 +68,12 @@ manage_window(xcb_window_t win, rule_consequence_t *csq, int fd)
 
     parse_rule_consequence(fd, csq);
 
-    if (ignore_ewmn_struts && ewmh_handle_struts(win)) {
+    if (csq->props == NULL)
+        csq->props = fetch_window_props(win);
+
+    window_props_t *wp = csq->props;
+
+    if (ignore_ewmn_struts && wp != NULL && wp->has_struts && ewmh_apply_struts(wp->struts)) {
         monitor_t *m;
 
         for (*m = mon_head; m != NULL; m = m->next) {
@@ -77,8 +85,12 @@ manage_window(xcb_window_t win, rule_consequence_t *csq, int fd)
     }
 
     if (!csq->manage) {
+        intern_release(csq->class_id);
+        intern_release(csq->instance_id);
         free(csq->layer);
         free(csq->state);
+        free_window_props(csq->props);
+        csq->props = NULL;
         window_show(win);
 
         return false;
@@ -130,8 +142,8 @@ manage_window(xcb_window_t win, rule_consequence_t *csq, int fd)
     c->border_width = csq->border ? d->border_width : 0;
     n->client = c;
 
-    initialize_client(n);
-    initialize_floating_rectangle(n);
+    initialize_client(n, wp);
+    initialize_floating_rectangle(n, wp);
 
     if (csq->rect != NULL) {
         c->floating_rectangle = *csq->rect;
@@ -147,8 +159,12 @@ manage_window(xcb_window_t win, rule_consequence_t *csq, int fd)
     if (csq->center)
         window_center(m, c);
 
-    snprintf(c->class_name, sizeof(c->class_name), "%s", csq->class_name);
-    snprintf(c->instance_name, sizeof(c->instance_name), "%s", csq->instance_name);
+    /* The client takes over the consequence's references. */
+    intern_release(c->class_id);
+    intern_release(c->instance_id);
+    c->class_id = csq->class_id;
+    c->instance_id = csq->instance_id;
+    csq->class_id = csq->instance_id = 0;
 
     if ((csq->state != NULL && (*(csq->state) == STATE_FLOATING ||
         *(csq->state) == STATE_FULLSCREEN)) || csq->hidden)
@@ -171,6 +187,8 @@ manage_window(xcb_window_t win, rule_consequence_t *csq, int fd)
     if (csq->layer != NULL)
         c->layer = *(csq->layer);
 
+    update_node_flags(n);
+
     if (csq->state != NULL)
         set_state(m, d, n, *(csq->state));
 
@@ -207,6 +225,8 @@ manage_window(xcb_window_t win, rule_consequence_t *csq, int fd)
 
     free(csq->layer);
     free(csq->state);
+    free_window_props(csq->props);
+    csq->props = NULL;
 
     return true;
 }
@@ -434,7 +454,17 @@ draw_border(node_t *n, bool, focused_node, bool focused_monitor)
 void
 window_draw_border(xcb_window_t win, uint32_t border_color_pxl)
 {
+    window_shadow_t *s = window_shadow(win);
+
+    if (s != NULL && (s->known & SHADOW_BORDER_PIXEL) && s->border_pixel == border_color_pxl)
+        return;
+
     xcb_change_window_attributes(dpy, win, XCB_CW_BORDER_PIXEL, &border_color_pxl);
+
+    if (s != NULL) {
+        s->border_pixel = border_color_pxl;
+        s->known |= SHADOW_BORDER_PIXEL;
+    }
 }
 
 void
@@ -473,15 +503,99 @@ get_border_color(bool focused_node, bool focused_monitor)
 }
 
 void
-initialize_floating_rectangle(node_t *n)
+initialize_floating_rectangle(node_t *n, window_props_t *wp)
 {
     client_t *c = n->client;
-    xcb_get_geometry_reply_t *geo = xcb_get_geometry_reply(dpy, xcb_get_geometry(dpy, n->id), NULL);
 
-    if (geo != NULL)
-        c->floating_rectangle = (xcb_rectangle_t) { geo->x, geo->y, geo->width, geo->height };
+    if (wp != NULL && wp->has_geometry)
+        c->floating_rectangle = wp->geometry;
+}
 
-    free(geo);
+/**
+ * Send every request first and only then wait for the replies, the
+ * server answers all of them in the same round-trip.
+**/
+window_props_t *
+fetch_window_props(xcb_window_t win)
+{
+    window_props_t *wp = calloc(1, sizeof(window_props_t));
+
+    if (wp == NULL) {
+        perror("window: calloc");
+
+        return NULL;
+    }
+
+    xcb_get_window_attributes_cookie_t attributes_ck = xcb_get_window_attributes(dpy, win);
+    xcb_get_geometry_cookie_t geometry_ck = xcb_get_geometry(dpy, win);
+    xcb_get_property_cookie_t window_type_ck = xcb_ewmh_get_wm_window_type(ewmh, win);
+    xcb_get_property_cookie_t wm_state_ck = xcb_ewmh_get_wm_state(ewmh, win);
+    xcb_get_property_cookie_t struts_ck = xcb_ewmh_get_wm_strut_partial(ewmh, win);
+    xcb_get_property_cookie_t transient_ck = xcb_icccm_get_wm_transient_for(dpy, win);
+    xcb_get_property_cookie_t size_hints_ck = xcb_icccm_get_wm_normal_hints(dpy, win);
+    xcb_get_property_cookie_t hints_ck = xcb_icccm_get_wm_hints(dpy, win);
+    xcb_get_property_cookie_t class_ck = xcb_icccm_get_wm_class(dpy, win);
+    xcb_get_property_cookie_t name_ck = xcb_icccm_get_wm_name(dpy, win);
+    xcb_get_property_cookie_t protocols_ck = xcb_icccm_get_wm_protocols(dpy, win,
+        ewmh->WM_PROTOCOLS);
+
+    xcb_get_window_attributes_reply_t *wa = xcb_get_window_attributes_reply(dpy,
+        attributes_ck, NULL);
+
+    if (wa != NULL) {
+        wp->override_redirect = wa->override_redirect;
+        free(wa);
+    }
+
+    xcb_get_geometry_reply_t *geo = xcb_get_geometry_reply(dpy, geometry_ck, NULL);
+
+    if (geo != NULL) {
+        wp->has_geometry = true;
+        wp->geometry = (xcb_rectangle_t) { geo->x, geo->y, geo->width, geo->height };
+        free(geo);
+    }
+
+    wp->has_window_type = (xcb_ewmh_get_wm_window_type_reply(ewmh, window_type_ck,
+        &wp->window_type, NULL) == 1);
+    wp->has_wm_state = (xcb_ewmh_get_wm_state_reply(ewmh, wm_state_ck, &wp->wm_state, NULL) == 1);
+    wp->has_struts = (xcb_ewmh_get_wm_strut_partial_reply(ewmh, struts_ck, &wp->struts, NULL) == 1);
+
+    wp->transient_for = XCB_NONE;
+    xcb_icccm_get_wm_transient_for_reply(dpy, transient_ck, &wp->transient_for, NULL);
+
+    wp->has_size_hints = (xcb_icccm_get_wm_normal_hints_reply(dpy, size_hints_ck,
+        &wp->size_hints, NULL) == 1);
+    wp->has_hints = (xcb_icccm_get_wm_hints_reply(dpy, hints_ck, &wp->hints, NULL) == 1);
+    wp->has_class = (xcb_icccm_get_wm_class_reply(dpy, class_ck, &wp->wm_class, NULL) == 1);
+    wp->has_name = (xcb_icccm_get_wm_name_reply(dpy, name_ck, &wp->wm_name, NULL) == 1);
+    wp->has_protocols = (xcb_icccm_get_wm_protocols_reply(dpy, protocols_ck, &wp->protocols,
+        NULL) == 1);
+
+    return wp;
+}
+
+void
+free_window_props(window_props_t *wp)
+{
+    if (wp == NULL)
+        return;
+
+    if (wp->has_window_type)
+        xcb_ewmh_get_atoms_reply_wipe(&wp->window_type);
+
+    if (wp->has_wm_state)
+        xcb_ewmh_get_atoms_reply_wipe(&wp->wm_state);
+
+    if (wp->has_class)
+        xcb_icccm_get_wm_class_reply_wipe(&wp->wm_class);
+
+    if (wp->has_name)
+        xcb_icccm_get_text_property_reply_wipe(&wp->wm_name);
+
+    if (wp->has_protocols)
+        xcb_icccm_get_wm_protocols_reply_wipe(&wp->protocols);
+
+    free(wp);
 }
 
 xcb_rectangle_t
@@ -666,6 +780,7 @@ resize_client(coordinates_t *loc, resize_handle_t rh, int dx, int dy, bool relat
                     "%ux%u+%i+%i\n", loc->monitor, loc->desktop->id, loc->node->id,
                     width, height, x, y);
         } else {
+            invalidate_layout(loc->node);
             arrange(loc->monitor, loc->desktop);
         }
     }
@@ -685,29 +800,31 @@ apply_size_hints(client_t *c, uint16_t *width, uint16_t *height)
     if (c->state == STATE_FULLSCREEN)
         return;
 
-    if (c->size_hints.flags & XCB_ICCCM_SIZE_HINT_BASE_SIZE) {
-        basew = c->size_hints.base_width;
-        baseh = c->size_hints.base_height;
+    xcb_size_hints_t *hints = &c->info->size_hints;
+
+    if (hints->flags & XCB_ICCCM_SIZE_HINT_BASE_SIZE) {
+        basew = hints->base_width;
+        baseh = hints->base_height;
         real_basew = basew;
         real_baseh = baseh;
-    } else if (c->size_hints.flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE) {
+    } else if (hints->flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE) {
         /* Base size is substituted with min size if not specified */
-        basew = c->size_hints.min_width;
-        baseh = c->size_hints.min_height;
+        basew = hints->min_width;
+        baseh = hints->min_height;
     }
 
-    if (c->size_hints.flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE) {
-        minw = c->size_hints.min_width;
-        minh = c->size_hints.min_height;
-    } else if (c->size_hints.flags & XCB_ICCCM_SIZE_HINT_BASE_SIZE) {
+    if (hints->flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE) {
+        minw = hints->min_width;
+        minh = hints->min_height;
+    } else if (hints->flags & XCB_ICCCM_SIZE_HINT_BASE_SIZE) {
         /* Min size is substituted with base size if not specified */
-        minw = c->size_hints.base_width;
-        minh = c->size_hints.base_height;
+        minw = hints->base_width;
+        minh = hints->base_height;
     }
 
     /* Handle the size aspect ratio */
-    if (c->size_hints.flags & XCB_ICCCM_SIZE_HINT_P_ASPECT && c->size_hints.min_aspect_den > 0 &&
-        c->size_hints.max_aspect_den > 0 && *height > real_baseh && *width > real_basew) {
+    if (hints->flags & XCB_ICCCM_SIZE_HINT_P_ASPECT && hints->min_aspect_den > 0 &&
+        hints->max_aspect_den > 0 && *height > real_baseh && *width > real_basew) {
             /**
              * ICCCM:
              * If a base size is provided along with the aspect ratio fields, the base size should
@@ -719,8 +836,8 @@ apply_size_hints(client_t *c, uint16_t *width, uint16_t *height)
             double dx = *width - real_basew;
             double dy = *height - real_baseh;
             double ratio = dx / dy;
-            double min = c->size_hints.min_aspect_num / (double)c->size_hints.min_aspect_den;
-            double max = c->size_hints.max_aspect_num / (double)c->size_hints.max_aspect_den;
+            double min = hints->min_aspect_num / (double)hints->min_aspect_den;
+            double max = hints->max_aspect_num / (double)hints->max_aspect_den;
 
             if (max > 0 && min > 0 && ratio > 0) {
                 if (ratio < min) {
@@ -741,24 +858,24 @@ apply_size_hints(client_t *c, uint16_t *width, uint16_t *height)
             *height = MAX(*height, minh);
 
             /* Handle the maximum size */
-            if (c->size_hints.flags & XCB_ICCCM_SIZE_HINT_P_MAX_SIZE) {
-                if (c->size_hints.max_width > 0)
-                    *width = MIN(*width, c->size_hints.max_width);
+            if (hints->flags & XCB_ICCCM_SIZE_HINT_P_MAX_SIZE) {
+                if (hints->max_width > 0)
+                    *width = MIN(*width, hints->max_width);
 
-                if (c->size_hints.max_height > 0)
-                    *height = MIN(*height, c->size_hints.max_height);
+                if (hints->max_height > 0)
+                    *height = MIN(*height, hints->max_height);
             }
 
             /* Handle the size increment */
-            if (c->size_hint.flags & (XCB_ICCCM_SIZE_HINT_P_RESIZE_INC |
-                XCB_ICCCM_SIZE_HINT_BASE_SIZE && c->size_hints.width_inc > 0 &&
-                c->size_hints.height_inc > 0)) {
+            if (hints->flags & (XCB_ICCCM_SIZE_HINT_P_RESIZE_INC |
+                XCB_ICCCM_SIZE_HINT_BASE_SIZE && hints->width_inc > 0 &&
+                hints->height_inc > 0)) {
                 uint16_t t1 = width, t2 = height;
                 unsigned_substract(t1, basew);
                 unsigned_substract(t2, baseh);
 
-                *width -= t1 % x->size_hints.width_inc;
-                *height -= t2 % c->size_hints.height_inc;
+                *width -= t1 % hints->width_inc;
+                *height -= t2 % hints->height_inc;
             }
     }
 }
@@ -879,36 +996,112 @@ disable_motion_recorder(void)
     motion_recorder.enabled = false;
 }
 
+/**
+ * Windows we don't manage (feedbacks, the motion recorder, ...) have no
+ * shadow and always get their requests sent.
+**/
+window_shadow_t *
+window_shadow(xcb_window_t win)
+{
+    coordinates_t loc;
+
+    if (!index_find(win, &loc) || loc.node->client == NULL)
+        return NULL;
+
+    return &loc.node->client->shadow;
+}
+
+/**
+ * Send the given geometry fields, leaving out those the server already
+ * has. Returns false if there was nothing left to send.
+**/
+static bool
+window_configure(xcb_window_t win, uint16_t mask, int16_t x, int16_t y, uint16_t w, uint16_t h)
+{
+    window_shadow_t *s = window_shadow(win);
+    bool pos_known = (s != NULL && (s->known & SHADOW_POSITION));
+    bool size_known = (s != NULL && (s->known & SHADOW_SIZE));
+    uint32_t values[4];
+    uint16_t changed = 0;
+    int i = 0;
+
+    if ((mask & XCB_CONFIG_WINDOW_X) && (!pos_known || s->rectangle.x != x)) {
+        changed |= XCB_CONFIG_WINDOW_X;
+        values[i++] = x;
+    }
+
+    if ((mask & XCB_CONFIG_WINDOW_Y) && (!pos_known || s->rectangle.y != y)) {
+        changed |= XCB_CONFIG_WINDOW_Y;
+        values[i++] = y;
+    }
+
+    if ((mask & XCB_CONFIG_WINDOW_WIDTH) && (!size_known || s->rectangle.width != w)) {
+        changed |= XCB_CONFIG_WINDOW_WIDTH;
+        values[i++] = w;
+    }
+
+    if ((mask & XCB_CONFIG_WINDOW_HEIGHT) && (!size_known || s->rectangle.height != h)) {
+        changed |= XCB_CONFIG_WINDOW_HEIGHT;
+        values[i++] = h;
+    }
+
+    if (changed == 0)
+        return false;
+
+    xcb_configure_window(dpy, win, changed, values);
+
+    if (s == NULL)
+        return true;
+
+    if (mask & XCB_CONFIG_WINDOW_X_Y) {
+        s->rectangle.x = x;
+        s->rectangle.y = y;
+        s->known |= SHADOW_POSITION;
+    }
+
+    if (mask & XCB_CONFIG_WINDOW_WIDTH_HEIGHT) {
+        s->rectangle.width = w;
+        s->rectangle.height = h;
+        s->known |= SHADOW_SIZE;
+    }
+
+    return true;
+}
+
 void
 window_border_width(xcb_window_t win, uint32_t bw)
 {
+    window_shadow_t *s = window_shadow(win);
+
+    if (s != NULL && (s->known & SHADOW_BORDER_WIDTH) && s->border_width == bw)
+        return;
+
     uint32_t values[] = { bw };
 
     xcb_configure_window(dpy, win, XCB_CONFIG_WINDOW_BORDER_WIDTH, values);
+
+    if (s != NULL) {
+        s->border_width = bw;
+        s->known |= SHADOW_BORDER_WIDTH;
+    }
 }
 
 void
 window_move(xcb_window_t win, int16_t x, int16_t y)
 {
-    uint32_t values[] = { x, y };
-
-    xcb_configure_window(dpy, win, XCB_CONFIG_WINDOW_X_Y, values);
+    window_configure(win, XCB_CONFIG_WINDOW_X_Y, x, y, 0, 0);
 }
 
 void
 window_resize(xcb_window_t win, uint16_t w, uint16_t h)
 {
-    uint32_t values[] = { w, h };
-
-    xcb_configure_window(dpy, win, XCB_CONFIG_WINDOW_WIDTH_HEIGHT, values);
+    window_configure(win, XCB_CONFIG_WINDOW_WIDTH_HEIGHT, 0, 0, w, h);
 }
 
-void
+bool
 window_move_resize(xcb_window_t win, int16_t x, int16_t y, uint16_t w, uint16_t h)
 {
-    uint32_t values[] = { x, y, w, h };
-
-    xcb_configure_window(dpy, win, XCB_CONFIG_WINDOW_X_Y_WIDTH_HEIGHT, values);
+    return window_configure(win, XCB_CONFIG_WINDOW_X_Y_WIDTH_HEIGHT, x, y, w, h);
 }
 
 void
@@ -931,15 +1124,54 @@ window_center(monitor_t *m, client_t *c)
     r->y -= c->border_width;
 }
 
+/**
+ * A restack is only redundant if it repeats the very last one: any other
+ * restack in between might have moved a window next to the sibling.
+**/
+static uint64_t stack_generation = 0;
+
+static bool
+window_restacked(window_shadow_t *s, xcb_window_t sibling, uint32_t mode)
+{
+    return (s != NULL && (s->known & SHADOW_STACKING) && s->sibling == sibling &&
+        s->stack_mode == mode && s->stack_generation == stack_generation);
+}
+
+static void
+window_stacked(window_shadow_t *s, xcb_window_t sibling, uint32_t mode)
+{
+    stack_generation++;
+
+    if (s == NULL)
+        return;
+
+    s->sibling = sibling;
+    s->stack_mode = mode;
+    s->stack_generation = stack_generation;
+    s->known |= SHADOW_STACKING;
+}
+
+void
+window_stacking_changed(void)
+{
+    stack_generation++;
+}
+
 void
 window_stack(xcb_window_t w1, xcb_window_t w2, uint32_t mode)
 {
     if (w2 == XCB_NONE)
         return;
 
+    window_shadow_t *s = window_shadow(w1);
+
+    if (window_restacked(s, w2, mode))
+        return;
+
     uint16_t mask = XCB_CONFIG_WINDOW_SIBLING | XCB_CONFIG_WINDOW_STACK_MODE;
     uint32_t values[] = { w2, mode };
     xcb_configure_window(dpy, w1, mask, values);
+    window_stacked(s, w2, mode);
 }
 
 /* Stack w1 above w2 */
@@ -959,14 +1191,25 @@ window_below(xcb_window_t w1, xcb_window_t w2)
 void
 window_lower(xcb_window_t win)
 {
+    window_shadow_t *s = window_shadow(win);
+
+    if (window_restacked(s, XCB_NONE, XCB_STACK_MODE_BELOW))
+        return;
+
     uint32_t values[] = { XCB_STACK_MODE_BELOW };
 
     xcb_configure_window(dpy, win, XCB_CONFIGURE_WINDOW_STACK_MODE, values);
+    window_stacked(s, XCB_NONE, XCB_STACK_MODE_BELOW);
 }
 
 void
 window_set_visibility(xcb_window_t win, bool visible)
 {
+    window_shadow_t *s = window_shadow(win);
+
+    if (s != NULL && (s->known & SHADOW_MAPPED) && s->mapped == visible)
+        return;
+
     uint32_t values_off[] = { ROOT_EVENT_MASK & ~XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY };
     uint32_t values_on[] = { ROOT_EVENT_MASK };
 
@@ -981,6 +1224,11 @@ window_set_visibility(xcb_window_t win, bool visible)
     }
 
     xcb_change_window_attributes(dpy, root, XCB_CW_EVENT_MASK, values_on);
+
+    if (s != NULL) {
+        s->mapped = visible;
+        s->known |= SHADOW_MAPPED;
+    }
 }
 
 void
@@ -1007,9 +1255,9 @@ set_input_focus(node_t *n)
     if (n == NULL || n->client == NULL) {
         clear_input_focus();
     } else {
-        if (n->client->icccm_props.input_hint)
+        if (n->client->info->icccm_props.input_hint)
             xcb_set_input_focus(dpy, XCB_INPUT_FOCUS_PARENT, n->id, XCB_CURRENT_TIME);
-        else if (n->client->icccm_props.take_focus)
+        else if (n->client->info->icccm_props.take_focus)
             sent_client_message(n->id, ewmh->WM_PROTOCOLS, WM_TAKE_FOCUS);
     }
 }
@@ -28,7 +28,9 @@ void draw_border(node_t *n, bool focused_node, bool focused_monitor);
 void window_draw_border(xcb_window_t win, uint32_t border_color_pxl);
 void adopt_orphans(void);
 uint32_t get_border_color(bool focused_node, bool focused_monitor);
-void initialize_floating_rectangle(node_t *n);
+void initialize_floating_rectangle(node_t *n, window_props_t *wp);
+window_props_t *fetch_window_props(xcb_window_t win);
+void free_window_props(window_props_t *wp);
 xcb_rectangle_t get_window_rectangle(node_t *n);
 bool move_client(coordinates_t *loc, int dx, int dy);
 bool resize_client(coordinates_t *loc, resize_handle_t rh, int dx, int dy, bool relative);
@@ -37,15 +39,17 @@ void query_ponter(xcb_window_t *win, xcb_point_t *pt);
 void update_motion_recorder(void);
 void enable_motion_recorder(xcb_window_t win);
 void disable_motion_recorder(void);
+window_shadow_t *window_shadow(xcb_window_t win);
 void window_border_width(xcb_window_t win, uint32_t bw);
 void window_move(xcb_window_t win, int16_t int16_t x, int16_t y);
 void window_resize(xcb_window_t win, uint16_t w, uint16_t h);
-void window_move_resize(xcb_window_t win, int16_t w, int16_t y, int16_t w, int16_t h);
+bool window_move_resize(xcb_window_t win, int16_t w, int16_t y, int16_t w, int16_t h);
 void window_center(monitor_t *m, client_t *c);
 void window_stack(xcb_window_t w1, xcb_window_t w2, uint32_t mode);
 void window_above(xcb_window_t w1, xcb_window_t w2);
 void window_below(xcb_window_t w1, xcb_window_t w2);
 void window_lower(xcb_window_t win);
+void window_stacking_changed(void);
 void window_set_visibility(xcb_window_t win, bool visible);
 void window_hide(xcb_window_t win);
 void window_show(xcb_window_t win);